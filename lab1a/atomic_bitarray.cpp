@@ -0,0 +1,121 @@
+#include "atomic_bitarray.h"
+
+
+AtomicBitArray::AtomicBitArray(size_t num_bits)
+    : num_bits(num_bits), words(new std::atomic<std::uint64_t>[(num_bits + 63) / 64])
+{
+    for (size_t i = 0; i < word_count(); ++i)
+        words[i].store(0, std::memory_order_relaxed);
+}
+
+
+AtomicBitArray::AtomicBitArray(const BitArray& b) : AtomicBitArray(b.size())
+{
+    for (size_t i = 0; i < word_count(); ++i)
+        words[i].store(b.word(i), std::memory_order_relaxed);
+}
+
+
+size_t AtomicBitArray::word_count() const
+{
+    return (num_bits + 63) / 64;
+}
+
+
+void AtomicBitArray::check_index(size_t n) const
+{
+    if (n >= num_bits) throw std::out_of_range("Index out of bounds");
+}
+
+
+void AtomicBitArray::check_load_order(std::memory_order order)
+{
+    if (order == std::memory_order_release || order == std::memory_order_acq_rel)
+        throw std::invalid_argument("Memory order is not valid for a load");
+}
+
+
+AtomicBitArray& AtomicBitArray::set(size_t n, bool val, std::memory_order order)
+{
+    if (val)
+        test_and_set(n, order);
+    else
+        fetch_reset(n, order);
+    return *this;
+}
+
+
+AtomicBitArray& AtomicBitArray::reset(size_t n, std::memory_order order)
+{
+    return set(n, false, order);
+}
+
+
+bool AtomicBitArray::test_and_set(size_t n, std::memory_order order)
+{
+    check_index(n);
+    std::uint64_t mask = 1ULL << (n % 64);
+    return words[n / 64].fetch_or(mask, order) & mask;
+}
+
+
+bool AtomicBitArray::fetch_reset(size_t n, std::memory_order order)
+{
+    check_index(n);
+    std::uint64_t mask = 1ULL << (n % 64);
+    return words[n / 64].fetch_and(~mask, order) & mask;
+}
+
+
+bool AtomicBitArray::test(size_t n, std::memory_order order) const
+{
+    check_index(n);
+    check_load_order(order);
+    return (words[n / 64].load(order) >> (n % 64)) & 1;
+}
+
+
+bool AtomicBitArray::operator[](size_t n) const
+{
+    return test(n);
+}
+
+
+size_t AtomicBitArray::count() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < word_count(); ++i)
+        total += __builtin_popcountll(words[i].load(std::memory_order_relaxed));
+    return total;
+}
+
+
+bool AtomicBitArray::any() const
+{
+    for (size_t i = 0; i < word_count(); ++i)
+        if (words[i].load(std::memory_order_relaxed) != 0) return true;
+    return false;
+}
+
+
+bool AtomicBitArray::none() const
+{
+    return !any();
+}
+
+
+size_t AtomicBitArray::size() const
+{
+    return num_bits;
+}
+
+
+BitArray AtomicBitArray::snapshot(std::memory_order order) const
+{
+    check_load_order(order);
+    BitArray result(num_bits);
+    unsigned long* out = result.data();
+    for (size_t i = 0; i < word_count(); ++i)
+        out[i] = words[i].load(order);
+    return result;
+}
@@ -0,0 +1,49 @@
+#ifndef ATOMIC_BITARRAY_H
+#define ATOMIC_BITARRAY_H
+
+#include "bitarray.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Fixed-size bit array that many threads can update at once without a lock.
+// Every single-bit operation is one atomic read-modify-write on the word
+// holding the bit, with a caller-chosen memory order. Whole-array reads
+// (count(), any(), snapshot()) load the words one by one: they are wait-free
+// but not a single atomic view while writers are running.
+class AtomicBitArray {
+private:
+    size_t num_bits;  // Total number of bits in the array
+    std::unique_ptr<std::atomic<std::uint64_t>[]> words;  // Storage for the bits
+
+    [[nodiscard]] size_t word_count() const;
+    void check_index(size_t n) const;
+    static void check_load_order(std::memory_order order);  // Loads take relaxed, consume, acquire or seq_cst
+
+public:
+    explicit AtomicBitArray(size_t num_bits);
+    explicit AtomicBitArray(const BitArray& b);
+    AtomicBitArray(const AtomicBitArray&) = delete;
+    AtomicBitArray& operator=(const AtomicBitArray&) = delete;
+
+    AtomicBitArray& set(size_t n, bool val = true, std::memory_order order = std::memory_order_seq_cst);
+    AtomicBitArray& reset(size_t n, std::memory_order order = std::memory_order_seq_cst);
+
+    // Set (clear) bit n and return its previous value
+    bool test_and_set(size_t n, std::memory_order order = std::memory_order_seq_cst);
+    bool fetch_reset(size_t n, std::memory_order order = std::memory_order_seq_cst);
+
+    // test() and snapshot() load, so they reject release and acq_rel with invalid_argument
+    [[nodiscard]] bool test(size_t n, std::memory_order order = std::memory_order_seq_cst) const;
+    bool operator[](size_t n) const;
+
+    [[nodiscard]] size_t count() const;  // Relaxed loads
+    [[nodiscard]] bool any() const;
+    [[nodiscard]] bool none() const;
+    [[nodiscard]] size_t size() const;
+
+    // Copy into a plain BitArray, loading each word with the given order
+    [[nodiscard]] BitArray snapshot(std::memory_order order = std::memory_order_acquire) const;
+};
+
+#endif // ATOMIC_BITARRAY_H
@@ -0,0 +1,317 @@
+#include "bit_matrix.h"
+#include "bitarray_kernels.h"
+#include <utility>
+#include <vector>
+
+static constexpr size_t russians_bits = 8;  // Rows of b combined per Four Russians table
+
+
+bool BitMatrix::RowView::operator[](size_t c) const
+{
+    if (c >= num_cols) throw std::out_of_range("Index out of bounds");
+    return (words[c / 64] >> (c % 64)) & 1;
+}
+
+
+BitMatrix::RowView& BitMatrix::RowView::set(size_t c, bool val)
+{
+    if (c >= num_cols) throw std::out_of_range("Index out of bounds");
+    if (val)
+        words[c / 64] |= 1UL << (c % 64);
+    else
+        words[c / 64] &= ~(1UL << (c % 64));
+    return *this;
+}
+
+
+BitMatrix::RowView& BitMatrix::RowView::reset(size_t c)
+{
+    return set(c, false);
+}
+
+
+size_t BitMatrix::RowView::count() const
+{
+    return ConstRowView(*this).count();
+}
+
+
+bool BitMatrix::RowView::any() const
+{
+    return ConstRowView(*this).any();
+}
+
+
+BitMatrix::RowView& BitMatrix::RowView::operator|=(const ConstRowView& other)
+{
+    if (other.size() != num_cols) throw std::invalid_argument("Sizes must be equal");
+    active_kernels().or_words(words, other.data(), word_count());
+    return *this;
+}
+
+
+BitMatrix::RowView& BitMatrix::RowView::operator&=(const ConstRowView& other)
+{
+    if (other.size() != num_cols) throw std::invalid_argument("Sizes must be equal");
+    active_kernels().and_words(words, other.data(), word_count());
+    return *this;
+}
+
+
+BitMatrix::RowView& BitMatrix::RowView::operator|=(const BitArray& b)
+{
+    if (b.size() != num_cols) throw std::invalid_argument("Sizes must be equal");
+    active_kernels().or_words(words, b.data(), word_count());
+    return *this;
+}
+
+
+BitMatrix::RowView& BitMatrix::RowView::operator&=(const BitArray& b)
+{
+    if (b.size() != num_cols) throw std::invalid_argument("Sizes must be equal");
+    active_kernels().and_words(words, b.data(), word_count());
+    return *this;
+}
+
+
+BitArray BitMatrix::RowView::to_bit_array() const
+{
+    return ConstRowView(*this).to_bit_array();
+}
+
+
+bool BitMatrix::ConstRowView::operator[](size_t c) const
+{
+    if (c >= num_cols) throw std::out_of_range("Index out of bounds");
+    return (words[c / 64] >> (c % 64)) & 1;
+}
+
+
+size_t BitMatrix::ConstRowView::count() const
+{
+    return active_kernels().popcount(words, word_count());
+}
+
+
+bool BitMatrix::ConstRowView::any() const
+{
+    for (size_t i = 0; i < word_count(); ++i)
+        if (words[i] != 0) return true;
+    return false;
+}
+
+
+BitArray BitMatrix::ConstRowView::to_bit_array() const
+{
+    BitArray result(num_cols);
+    std::copy(words, words + word_count(), result.data());
+    return result;
+}
+
+
+size_t BitMatrix::ColumnView::count() const
+{
+    size_t total = 0;
+    for (size_t r = 0; r < matrix->rows(); ++r)
+        total += (matrix->row_data(r)[col / 64] >> (col % 64)) & 1;
+    return total;
+}
+
+
+BitArray BitMatrix::ColumnView::to_bit_array() const
+{
+    BitArray result(matrix->rows());
+    unsigned long* out = result.data();
+    for (size_t r = 0; r < matrix->rows(); ++r)
+        out[r / 64] |= ((matrix->row_data(r)[col / 64] >> (col % 64)) & 1) << (r % 64);
+    return result;
+}
+
+
+BitMatrix::BitMatrix() : num_rows(0), num_cols(0), words_per_row(0) {}
+
+
+BitMatrix::BitMatrix(size_t rows, size_t cols)
+    : num_rows(rows), num_cols(cols), words_per_row((cols + 63) / 64), storage(rows * ((cols + 63) / 64) * 64)
+{
+}
+
+
+BitMatrix BitMatrix::identity(size_t n)
+{
+    BitMatrix result(n, n);
+    for (size_t i = 0; i < n; ++i)
+        result.set(i, i);
+    return result;
+}
+
+
+size_t BitMatrix::rows() const
+{
+    return num_rows;
+}
+
+
+size_t BitMatrix::cols() const
+{
+    return num_cols;
+}
+
+
+size_t BitMatrix::row_words() const
+{
+    return words_per_row;
+}
+
+
+void BitMatrix::check_index(size_t r, size_t c) const
+{
+    if (r >= num_rows || c >= num_cols) throw std::out_of_range("Index out of bounds");
+}
+
+
+bool BitMatrix::get(size_t r, size_t c) const
+{
+    check_index(r, c);
+    return (row_data(r)[c / 64] >> (c % 64)) & 1;
+}
+
+
+bool BitMatrix::operator()(size_t r, size_t c) const
+{
+    return get(r, c);
+}
+
+
+BitMatrix& BitMatrix::set(size_t r, size_t c, bool val)
+{
+    check_index(r, c);
+    row(r).set(c, val);
+    return *this;
+}
+
+
+BitMatrix& BitMatrix::reset(size_t r, size_t c)
+{
+    return set(r, c, false);
+}
+
+
+BitMatrix& BitMatrix::reset()
+{
+    storage.reset();
+    return *this;
+}
+
+
+size_t BitMatrix::count() const
+{
+    return storage.count();
+}
+
+
+BitMatrix::RowView BitMatrix::row(size_t r)
+{
+    if (r >= num_rows) throw std::out_of_range("Index out of bounds");
+    return RowView(row_data(r), num_cols);
+}
+
+
+BitMatrix::ConstRowView BitMatrix::row(size_t r) const
+{
+    if (r >= num_rows) throw std::out_of_range("Index out of bounds");
+    return ConstRowView(row_data(r), num_cols);
+}
+
+
+BitMatrix::ColumnView BitMatrix::column(size_t c) const
+{
+    if (c >= num_cols) throw std::out_of_range("Index out of bounds");
+    return ColumnView(this, c);
+}
+
+
+BitMatrix& BitMatrix::set_row(size_t r, const BitArray& b)
+{
+    RowView dst = row(r);
+    if (b.size() != num_cols) throw std::invalid_argument("Sizes must be equal");
+    std::copy(b.data(), b.data() + words_per_row, dst.data());
+    return *this;
+}
+
+
+BitMatrix& BitMatrix::or_row(size_t dst, size_t src)
+{
+    row(dst) |= std::as_const(*this).row(src);
+    return *this;
+}
+
+
+BitMatrix& BitMatrix::and_row(size_t dst, size_t src)
+{
+    row(dst) &= std::as_const(*this).row(src);
+    return *this;
+}
+
+
+BitMatrix BitMatrix::transposed() const
+{
+    BitMatrix result(num_cols, num_rows);
+    unsigned long tile[64];
+    for (size_t row_block = 0; row_block < (num_rows + 63) / 64; ++row_block) {
+        const size_t tile_rows = std::min<size_t>(64, num_rows - row_block * 64);
+        for (size_t w = 0; w < words_per_row; ++w) {
+            for (size_t k = 0; k < 64; ++k)
+                tile[k] = k < tile_rows ? row_data(row_block * 64 + k)[w] : 0;
+            active_kernels().transpose_tile(tile);
+
+            const size_t tile_cols = std::min<size_t>(64, num_cols - w * 64);
+            for (size_t k = 0; k < tile_cols; ++k)
+                result.row_data(w * 64 + k)[row_block] = tile[k];
+        }
+    }
+    return result;
+}
+
+
+BitMatrix multiply(const BitMatrix& a, const BitMatrix& b)
+{
+    if (a.num_cols != b.num_rows) throw std::invalid_argument("Matrix dimensions do not match");
+
+    // Four Russians: for every group of eight rows of b, tabulate the OR of
+    // each of their 256 subsets once; a row of the product then takes one
+    // table row per group, picked by the matching byte of the row of a
+    BitMatrix result(a.num_rows, b.num_cols);
+    const size_t width = b.words_per_row;
+    const BitKernels& kernels = active_kernels();
+    std::vector<unsigned long> table(256 * width);
+    for (size_t first = 0; first < b.num_rows; first += russians_bits) {
+        const size_t group = std::min(russians_bits, b.num_rows - first);
+        std::fill(table.begin(), table.begin() + width, 0);
+        for (size_t v = 1; v < (size_t(1) << group); ++v) {
+            // Subset v is subset v & (v - 1) plus the row of v's lowest bit
+            unsigned long* entry = table.data() + v * width;
+            std::copy(table.data() + (v & (v - 1)) * width, table.data() + (v & (v - 1)) * width + width, entry);
+            kernels.or_words(entry, b.row_data(first + __builtin_ctzl(v)), width);
+        }
+
+        for (size_t i = 0; i < a.num_rows; ++i) {
+            const size_t v = (a.row_data(i)[first / 64] >> (first % 64)) & 0xff;
+            if (v != 0)
+                kernels.or_words(result.row_data(i), table.data() + v * width, width);
+        }
+    }
+    return result;
+}
+
+
+bool operator==(const BitMatrix& a, const BitMatrix& b)
+{
+    return a.num_rows == b.num_rows && a.num_cols == b.num_cols && a.storage == b.storage;
+}
+
+
+bool operator!=(const BitMatrix& a, const BitMatrix& b)
+{
+    return !(a == b);
+}
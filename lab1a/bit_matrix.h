@@ -0,0 +1,124 @@
+#ifndef BIT_MATRIX_H
+#define BIT_MATRIX_H
+
+#include "bitarray.h"
+#include <cstdint>
+
+// Dense Boolean matrix in one contiguous row-major buffer (a BitArray, so the
+// buffer is cache-line aligned). Every row starts on a word boundary and
+// occupies row_words() words; the padding bits past cols() are kept zero.
+// Row operations run the BitArray word kernels over a row's words; column
+// access is strided. transposed() works on 64x64 tiles and multiply() uses
+// the Four Russians method.
+class BitMatrix {
+private:
+    size_t num_rows;
+    size_t num_cols;
+    size_t words_per_row;  // (num_cols + 63) / 64
+    BitArray storage;  // num_rows * words_per_row words
+
+    [[nodiscard]] unsigned long* row_data(size_t r) { return storage.data() + r * words_per_row; }
+    [[nodiscard]] const unsigned long* row_data(size_t r) const { return storage.data() + r * words_per_row; }
+    void check_index(size_t r, size_t c) const;
+
+public:
+    class ConstRowView;
+
+    // A row, writable through the view; valid until the matrix is resized or destroyed
+    class RowView {
+    private:
+        unsigned long* words;
+        size_t num_cols;
+
+    public:
+        RowView(unsigned long* words, size_t num_cols) : words(words), num_cols(num_cols) {}
+
+        [[nodiscard]] size_t size() const { return num_cols; }
+        [[nodiscard]] size_t word_count() const { return (num_cols + 63) / 64; }
+        [[nodiscard]] unsigned long word(size_t i) const { return words[i]; }
+        [[nodiscard]] unsigned long* data() const { return words; }
+        bool operator[](size_t c) const;
+        RowView& set(size_t c, bool val = true);
+        RowView& reset(size_t c);
+        [[nodiscard]] size_t count() const;
+        [[nodiscard]] bool any() const;
+
+        RowView& operator|=(const ConstRowView& other);
+        RowView& operator&=(const ConstRowView& other);
+        RowView& operator|=(const BitArray& b);
+        RowView& operator&=(const BitArray& b);
+
+        [[nodiscard]] BitArray to_bit_array() const;
+    };
+
+    class ConstRowView {
+    private:
+        const unsigned long* words;
+        size_t num_cols;
+
+    public:
+        ConstRowView(const unsigned long* words, size_t num_cols) : words(words), num_cols(num_cols) {}
+        ConstRowView(const RowView& row) : words(row.data()), num_cols(row.size()) {}
+
+        [[nodiscard]] size_t size() const { return num_cols; }
+        [[nodiscard]] size_t word_count() const { return (num_cols + 63) / 64; }
+        [[nodiscard]] unsigned long word(size_t i) const { return words[i]; }
+        [[nodiscard]] const unsigned long* data() const { return words; }
+        bool operator[](size_t c) const;
+        [[nodiscard]] size_t count() const;
+        [[nodiscard]] bool any() const;
+        [[nodiscard]] BitArray to_bit_array() const;
+    };
+
+    // A column, read-only: one bit from every row
+    class ColumnView {
+    private:
+        const BitMatrix* matrix;
+        size_t col;
+
+    public:
+        ColumnView(const BitMatrix* matrix, size_t col) : matrix(matrix), col(col) {}
+
+        [[nodiscard]] size_t size() const { return matrix->rows(); }
+        bool operator[](size_t r) const { return matrix->get(r, col); }
+        [[nodiscard]] size_t count() const;
+        [[nodiscard]] BitArray to_bit_array() const;
+    };
+
+    BitMatrix();
+    BitMatrix(size_t rows, size_t cols);
+    static BitMatrix identity(size_t n);
+
+    [[nodiscard]] size_t rows() const;
+    [[nodiscard]] size_t cols() const;
+    [[nodiscard]] size_t row_words() const;
+
+    bool get(size_t r, size_t c) const;
+    bool operator()(size_t r, size_t c) const;
+    BitMatrix& set(size_t r, size_t c, bool val = true);
+    BitMatrix& reset(size_t r, size_t c);
+    BitMatrix& reset();  // Clears every bit
+    [[nodiscard]] size_t count() const;
+
+    RowView row(size_t r);
+    ConstRowView row(size_t r) const;
+    ColumnView column(size_t c) const;
+    BitMatrix& set_row(size_t r, const BitArray& b);
+
+    // Row dst |= (&=) row src
+    BitMatrix& or_row(size_t dst, size_t src);
+    BitMatrix& and_row(size_t dst, size_t src);
+
+    [[nodiscard]] BitMatrix transposed() const;
+
+    // Boolean product: result(i, j) = OR over k of a(i, k) & b(k, j)
+    friend BitMatrix multiply(const BitMatrix& a, const BitMatrix& b);
+    friend bool operator==(const BitMatrix& a, const BitMatrix& b);
+    friend bool operator!=(const BitMatrix& a, const BitMatrix& b);
+};
+
+BitMatrix multiply(const BitMatrix& a, const BitMatrix& b);
+bool operator==(const BitMatrix& a, const BitMatrix& b);
+bool operator!=(const BitMatrix& a, const BitMatrix& b);
+
+#endif // BIT_MATRIX_H
@@ -1,63 +1,271 @@
 #include "bitarray.h"
+#include "bitarray_kernels.h"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <latch>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Heap blocks start on a cache line, so parallel chunks of whole cache lines never share one
+static constexpr size_t heap_alignment = 64;
+static constexpr size_t words_per_cache_line = 8;
+
+
+BitArray::BitArray() : BitArray(allocator_type()) {}
+
+BitArray::BitArray(const allocator_type& alloc)
+    : num_bits(0), words(inline_words), capacity_words(inline_capacity), resource(alloc.resource()), inline_words{}
+{
+}
 
+BitArray::~BitArray() 
+{
+    release();
+}
 
-BitArray::BitArray() : num_bits(0) {}
+BitArray::BitArray(size_t num_bits, unsigned long value) : BitArray(num_bits, value, allocator_type()) {}
 
-BitArray::~BitArray() {}
+BitArray::BitArray(size_t num_bits, const allocator_type& alloc) : BitArray(num_bits, 0, alloc) {}
 
-BitArray::BitArray(int num_bits, unsigned long value) : num_bits(num_bits), data((num_bits + 63) / 64, 0) 
+BitArray::BitArray(size_t num_bits, unsigned long value, const allocator_type& alloc) : BitArray(alloc)
 {
+    if (num_bits > max_size())
+        throw std::invalid_argument("Size must be >=0");
+
+    size_t count = (num_bits + 63) / 64;
+    if (count > inline_capacity)
+        reallocate(count);
+    std::fill(words, words + count, 0);
+    this->num_bits = num_bits;
     if (num_bits > 0) 
-        data[0] = value;
+        words[0] = value;
+    clear_unused_bits();
 }
 
 // Copy constructor
-BitArray::BitArray(const BitArray& b) : num_bits(b.num_bits), data(b.data) {}
+BitArray::BitArray(const BitArray& b) : BitArray(b, allocator_type()) {}
 
-void BitArray::swap(BitArray& b) 
+BitArray::BitArray(const BitArray& b, const allocator_type& alloc) : BitArray(alloc)
 {
+    if (b.word_count() > inline_capacity)
+        reallocate(b.word_count());
+    std::copy(b.words, b.words + b.word_count(), words);
+    num_bits = b.num_bits;
+}
+
+// Move constructor
+BitArray::BitArray(BitArray&& b) noexcept
+    : num_bits(0), words(inline_words), capacity_words(inline_capacity), resource(b.resource), inline_words{}
+{
+    steal(b);
+}
+
+BitArray::BitArray(BitArray&& b, const allocator_type& alloc) : BitArray(alloc)
+{
+    // Not noexcept, so a failed copy throws here rather than terminating
+    if (resource->is_equal(*b.resource))
+        steal(b);
+    else
+        copy_across(b);
+}
+
+void BitArray::swap(BitArray& b) noexcept
+{
+    // Each heap block has to stay with the resource that allocated it
+    assert(resource->is_equal(*b.resource));
+    touch();
+    b.touch();
     std::swap(num_bits, b.num_bits);
-    std::swap(data, b.data);
+    std::swap(capacity_words, b.capacity_words);
+    std::swap(inline_words, b.inline_words);
+    std::swap(words, b.words);
+    // Inline contents moved with the arrays, so the pointers must follow them
+    if (words == b.inline_words)
+        words = inline_words;
+    if (b.words == inline_words)
+        b.words = b.inline_words;
+}
+
+
+BitArray::allocator_type BitArray::get_allocator() const
+{
+    return allocator_type(resource);
+}
+
+
+size_t BitArray::hash() const noexcept
+{
+    return hash_bit_words(words, word_count(), num_bits);
 }
 
 
 BitArray& BitArray::operator=(const BitArray& b) 
 {
-    if (this != &b) {
-        BitArray temp(b);
+    if (this == &b)
+        return *this;
+
+    if (capacity_words >= b.word_count()) {
+        // Reuse the buffer we already own
+        touch();
+        std::copy(b.words, b.words + b.word_count(), words);
+        num_bits = b.num_bits;
+    } else {
+        BitArray temp(b, get_allocator());
         swap(temp);
     }
     return *this;
 }
 
 
-void BitArray::resize(int new_size, bool value)
+BitArray& BitArray::operator=(BitArray&& b) noexcept
 {
-    if (new_size < 0)
+    if (this == &b)
+        return *this;
+
+    // A block can only be taken over if it can be freed through our resource
+    if (resource->is_equal(*b.resource))
+        steal(b);
+    else
+        copy_across(b);
+    return *this;
+}
+
+
+// The move assignment fallback for unequal resources: the words are copied
+// into a block of ours and b is emptied, like a pmr container whose
+// allocator does not propagate on move assignment
+void BitArray::copy_across(BitArray& b)
+{
+    *this = b;
+    b.touch();
+    b.release();
+    b.num_bits = 0;
+}
+
+
+void BitArray::steal(BitArray& b) noexcept
+{
+    touch();
+    b.touch();
+    release();
+    if (b.words == b.inline_words) {
+        std::copy(b.inline_words, b.inline_words + inline_capacity, inline_words);
+    } else {
+        words = b.words;
+        capacity_words = b.capacity_words;
+        b.words = b.inline_words;
+        b.capacity_words = inline_capacity;
+    }
+    num_bits = b.num_bits;
+    b.num_bits = 0;
+}
+
+
+size_t BitArray::word_count() const
+{
+    return (num_bits + 63) / 64;
+}
+
+
+void BitArray::reallocate(size_t new_capacity)
+{
+    unsigned long* new_words = new_capacity <= inline_capacity
+        ? inline_words
+        : static_cast<unsigned long*>(resource->allocate(new_capacity * sizeof(unsigned long), heap_alignment));
+    if (new_words != words)
+        std::copy(words, words + word_count(), new_words);
+    release();
+    words = new_words;
+    capacity_words = std::max(new_capacity, inline_capacity);
+}
+
+
+void BitArray::grow(size_t min_capacity)
+{
+    if (min_capacity > capacity_words)
+        reallocate(std::max(min_capacity, 2 * capacity_words));
+}
+
+
+void BitArray::release()
+{
+    if (words != inline_words)
+        resource->deallocate(words, capacity_words * sizeof(unsigned long), heap_alignment);
+    words = inline_words;
+    capacity_words = inline_capacity;
+}
+
+
+void BitArray::resize(size_t new_size, bool value)
+{
+    if (new_size > max_size())
         throw std::invalid_argument("Size mmust be >=0");
 
-    std::vector<unsigned long> new_data((new_size + 64 - 1) / 64, value ? ~0UL : 0);
-    int copy_bits = std::min(num_bits, new_size);
-    for (int i = 0; i < copy_bits; ++i)
-        if ((*this)[i])
-            new_data[i / 64] |= (1UL << (i % 64));
+    touch();
+    // New bits sharing the old last word have to be filled by hand
+    if (value && new_size > num_bits && num_bits % 64 != 0)
+        words[word_count() - 1] |= ~0UL << (num_bits % 64);
 
-    data = std::move(new_data);
+    size_t old_count = word_count();
+    size_t new_count = (new_size + 63) / 64;
+    grow(new_count);
+    if (new_count > old_count)
+        std::fill(words + old_count, words + new_count, value ? ~0UL : 0);
     num_bits = new_size;
+    clear_unused_bits();
+}
+
+
+void BitArray::reserve(size_t capacity_bits)
+{
+    if (capacity_bits > max_size())
+        throw std::invalid_argument("Capacity must be >=0");
+    size_t count = (capacity_bits + 63) / 64;
+    if (count > capacity_words)
+        reallocate(count);
+}
+
+
+void BitArray::shrink_to_fit()
+{
+    if (capacity_words > std::max(word_count(), inline_capacity))
+        reallocate(word_count());
+}
+
+
+size_t BitArray::capacity() const
+{
+    return std::min(capacity_words * 64, max_size());
 }
 
 
 void BitArray::clear() 
 {
-    data.clear();
+    touch();
     num_bits = 0;
 }
 
 
 void BitArray::push_back(bool bit)
 {
-    resize(num_bits + 1);
-    set(num_bits - 1, bit);
+    touch();
+    if (num_bits % 64 == 0) {
+        grow(word_count() + 1);  // Geometric growth keeps appends amortized O(1)
+        words[word_count()] = 0;
+    }
+
+    unsigned long mask = 1UL << (num_bits % 64);
+    if (bit)
+        words[num_bits / 64] |= mask;
+    else
+        words[num_bits / 64] &= ~mask;
+    ++num_bits;
 }
 
 
@@ -65,8 +273,8 @@ BitArray& BitArray::operator&=(const BitArray& b)
 {
     if (num_bits != b.num_bits) throw std::invalid_argument("Sizes must be equal");
     
-    for (size_t i = 0; i < data.size(); ++i)
-        data[i] &= b.data[i];
+    touch();
+    active_kernels().and_words(words, b.words, word_count());
     
     return *this;
 }
@@ -76,8 +284,8 @@ BitArray& BitArray::operator|=(const BitArray& b)
 {
     if (num_bits != b.num_bits) throw std::invalid_argument("Sizes must be equal");
     
-    for (size_t i = 0; i < data.size(); ++i) 
-        data[i] |= b.data[i];
+    touch();
+    active_kernels().or_words(words, b.words, word_count());
     
     return *this;
 }
@@ -87,64 +295,169 @@ BitArray& BitArray::operator^=(const BitArray& b)
 {
     if (num_bits != b.num_bits) throw std::invalid_argument("Sizes must be equal");
     
-    for (size_t i = 0; i < data.size(); ++i) 
-        data[i] ^= b.data[i];
+    touch();
+    active_kernels().xor_words(words, b.words, word_count());
     
     return *this;
 }
 
 
-BitArray& BitArray::operator<<=(int n) {
+BitArray& BitArray::operator<<=(size_t n)
+{
+    if (n > max_size()) throw std::invalid_argument("Shift must be >=0");
+    touch();
     if (n >= num_bits) {
-        std::fill(data.begin(), data.end(), 0);
+        std::fill(words, words + word_count(), 0);
         return *this;
     }
-    std::rotate(data.rbegin(), data.rbegin() + n / 64, data.rend());
-    for (int i = 0; i < n % 64; ++i) {
-        for (size_t j = 0; j < data.size(); ++j)
-            data[j] = (data[j] << 1) | (j + 1 < data.size() ? (data[j + 1] >> 63) : 0);
+
+    // Locals, because stores through the word pointer could alias the
+    // object's own fields and would force them to be reloaded every iteration
+    unsigned long* const w = words;
+    const size_t count = word_count();
+    const size_t word_shift = n / 64;
+    const unsigned bit_shift = n % 64;
+    if (bit_shift == 0) {
+        std::copy_backward(w, w + count - word_shift, w + count);
+    } else {
+        // One pass from the top: each word is a funnel shift of two source words
+        for (size_t j = count - 1; j > word_shift; --j)
+            w[j] = (w[j - word_shift] << bit_shift) | (w[j - word_shift - 1] >> (64 - bit_shift));
+        w[word_shift] = w[0] << bit_shift;
     }
+    std::fill(w, w + word_shift, 0);
+    clear_unused_bits();
     return *this;
 }
 
 
-BitArray& BitArray::operator>>=(int n) {
+BitArray& BitArray::operator>>=(size_t n)
+{
+    if (n > max_size()) throw std::invalid_argument("Shift must be >=0");
+    touch();
     if (n >= num_bits) {
-        std::fill(data.begin(), data.end(), 0);
+        std::fill(words, words + word_count(), 0);
         return *this;
     }
-    std::rotate(data.begin(), data.begin() + n / 64, data.end());
-    for (int i = 0; i < n % 64; ++i) {
-        for (size_t j = data.size(); j > 0; --j)
-            data[j - 1] = (data[j - 1] >> 1) | (j > 1 ? (data[j - 2] << 63) : 0);
+
+    unsigned long* const w = words;
+    const size_t count = word_count();
+    const size_t word_shift = n / 64;
+    const unsigned bit_shift = n % 64;
+    const size_t kept = count - word_shift;
+    if (bit_shift == 0) {
+        std::copy(w + word_shift, w + count, w);
+    } else {
+        for (size_t j = 0; j + 1 < kept; ++j)
+            w[j] = (w[j + word_shift] >> bit_shift) | (w[j + word_shift + 1] << (64 - bit_shift));
+        w[kept - 1] = w[count - 1] >> bit_shift;
     }
+    std::fill(w + kept, w + count, 0);
     return *this;
 }
 
 
+// Copies bits [first, first + n) of src, which has src_words words, to the
+// start of dst, leaving the bits of dst past n zero
+static void extract_bits(const unsigned long* src, size_t src_words, size_t first, size_t n, unsigned long* dst)
+{
+    const size_t base = first / 64;
+    const unsigned s = first % 64;
+    const size_t out = (n + 63) / 64;
+    for (size_t j = 0; j < out; ++j) {
+        unsigned long word = src[base + j] >> s;
+        if (s != 0 && base + j + 1 < src_words)
+            word |= src[base + j + 1] << (64 - s);
+        dst[j] = word;
+    }
+    dst[out - 1] &= last_word_mask(n);
+}
+
+// ORs the first n bits of src (zero past n) into dst, which has dst_words
+// words, starting at bit first
+static void or_bits_at(unsigned long* dst, size_t dst_words, size_t first, const unsigned long* src, size_t n)
+{
+    const size_t base = first / 64;
+    const unsigned s = first % 64;
+    for (size_t j = 0; j < (n + 63) / 64; ++j) {
+        dst[base + j] |= src[j] << s;
+        if (s != 0 && base + j + 1 < dst_words)
+            dst[base + j + 1] |= src[j] >> (64 - s);
+    }
+}
+
+
+BitArray& BitArray::rotate_left(size_t n)
+{
+    if (n > max_size()) throw std::invalid_argument("Shift must be >=0");
+    if (num_bits == 0 || n % num_bits == 0)
+        return *this;
+
+    // Only the bits that wrap around are set aside, from whichever side is
+    // shorter, in our own resource; up to 128 of them fit the inline buffer,
+    // so small rotations do not allocate. The rest moves by an in-place shift.
+    n %= num_bits;
+    if (n <= num_bits - n) {
+        BitArray wrapped(n, get_allocator());
+        extract_bits(words, word_count(), num_bits - n, n, wrapped.words);
+        *this <<= n;
+        or_bits_at(words, word_count(), 0, wrapped.words, n);
+    } else {
+        const size_t k = num_bits - n;  // The same as rotating right by k
+        BitArray wrapped(k, get_allocator());
+        extract_bits(words, word_count(), 0, k, wrapped.words);
+        *this >>= k;
+        or_bits_at(words, word_count(), num_bits - k, wrapped.words, k);
+    }
+    return *this;
+}
+
+
+BitArray& BitArray::rotate_right(size_t n)
+{
+    if (n > max_size()) throw std::invalid_argument("Shift must be >=0");
+    if (num_bits == 0)
+        return *this;
+    return rotate_left(num_bits - n % num_bits);
+}
+
+
 // (const version)
-BitArray BitArray::operator<<(int n) const {
+BitArray BitArray::operator<<(size_t n) const& {
     BitArray result(*this);
     result <<= n;
     return result;
 }
 
 // (const version)
-BitArray BitArray::operator>>(int n) const {
+BitArray BitArray::operator>>(size_t n) const& {
     BitArray result(*this);
     result >>= n;
     return result;
 }
 
+// (rvalue version)
+BitArray BitArray::operator<<(size_t n) && {
+    *this <<= n;
+    return std::move(*this);
+}
+
+// (rvalue version)
+BitArray BitArray::operator>>(size_t n) && {
+    *this >>= n;
+    return std::move(*this);
+}
+
 
-BitArray& BitArray::set(int n, bool val) 
+BitArray& BitArray::set(size_t n, bool val) 
 {
-    if (n < 0 || n >= num_bits) throw std::out_of_range("Index out of bounds");
+    if (n >= num_bits) throw std::out_of_range("Index out of bounds");
     
+    touch();
     if (val) 
-        data[n / 64] |= (1UL << (n % 64));
+        words[n / 64] |= (1UL << (n % 64));
     else 
-        data[n / 64] &= ~(1UL << (n % 64));
+        words[n / 64] &= ~(1UL << (n % 64));
     
     return *this;
 }
@@ -152,12 +465,14 @@ BitArray& BitArray::set(int n, bool val)
 
 BitArray& BitArray::set() 
 {
-    std::fill(data.begin(), data.end(), ~0UL);
+    touch();
+    std::fill(words, words + word_count(), ~0UL);
+    clear_unused_bits();
     return *this;
 }
 
 
-BitArray& BitArray::reset(int n) 
+BitArray& BitArray::reset(size_t n) 
 {
     return set(n, false);
 }
@@ -165,14 +480,160 @@ BitArray& BitArray::reset(int n)
 
 BitArray& BitArray::reset() 
 {
-    std::fill(data.begin(), data.end(), 0);
+    touch();
+    std::fill(words, words + word_count(), 0);
+    return *this;
+}
+
+
+BitArray& BitArray::flip()
+{
+    touch();
+    active_kernels().not_words(words, words, word_count());
+    clear_unused_bits();
+    return *this;
+}
+
+
+// Splits [first, last) into its boundary words, passed to partial(i, mask)
+// with the mask of the bits in range, and the run of n whole words starting
+// at word i in between, passed to whole(i, n)
+template <typename Partial, typename Whole>
+static void for_each_range_word(size_t first, size_t last, Partial partial, Whole whole)
+{
+    if (first == last)
+        return;
+
+    const size_t first_word = first / 64;
+    const size_t last_word = (last - 1) / 64;
+    const unsigned long head = ~0UL << (first % 64);
+    const unsigned long tail = last_word_mask(last);
+    if (first_word == last_word) {
+        partial(first_word, head & tail);
+        return;
+    }
+    partial(first_word, head);
+    if (last_word - first_word > 1)
+        whole(first_word + 1, last_word - first_word - 1);
+    partial(last_word, tail);
+}
+
+
+static void check_range(size_t first, size_t last, size_t size)
+{
+    if (first > last || last > size) throw std::out_of_range("Range out of bounds");
+}
+
+
+BitArray& BitArray::set_range(size_t first, size_t last, bool val)
+{
+    check_range(first, last, num_bits);
+    touch();
+    for_each_range_word(first, last,
+        [&](size_t i, unsigned long mask) { words[i] = val ? words[i] | mask : words[i] & ~mask; },
+        [&](size_t i, size_t n) { std::fill(words + i, words + i + n, val ? ~0UL : 0); });
+    return *this;
+}
+
+
+BitArray& BitArray::reset_range(size_t first, size_t last)
+{
+    return set_range(first, last, false);
+}
+
+
+BitArray& BitArray::flip_range(size_t first, size_t last)
+{
+    check_range(first, last, num_bits);
+    touch();
+    for_each_range_word(first, last,
+        [&](size_t i, unsigned long mask) { words[i] ^= mask; },
+        [&](size_t i, size_t n) { active_kernels().not_words(words + i, words + i, n); });
     return *this;
 }
 
 
+size_t BitArray::count_range(size_t first, size_t last) const
+{
+    check_range(first, last, num_bits);
+    size_t total = 0;
+    for_each_range_word(first, last,
+        [&](size_t i, unsigned long mask) { total += __builtin_popcountl(words[i] & mask); },
+        [&](size_t i, size_t n) { total += active_kernels().popcount(words + i, n); });
+    return total;
+}
+
+
+// How many indices ahead the batched accessors prefetch; enough to keep
+// several cache misses in flight
+static constexpr size_t prefetch_distance = 16;
+
+static void check_indices(std::span<const std::uint64_t> indices, size_t size)
+{
+    std::uint64_t max_index = 0;
+    for (std::uint64_t i : indices)
+        max_index = std::max(max_index, i);
+    if (!indices.empty() && max_index >= size) throw std::out_of_range("Index out of bounds");
+}
+
+// Calls f(j, word index, bit mask) for every indices[j], prefetching the
+// word prefetch_distance indices ahead for reading or for writing
+template <bool ForWrite, typename F>
+static void for_each_index(std::span<const std::uint64_t> indices, const unsigned long* words, F f)
+{
+    for (size_t j = 0; j < indices.size(); ++j) {
+        if (j + prefetch_distance < indices.size())
+            __builtin_prefetch(words + indices[j + prefetch_distance] / 64, ForWrite ? 1 : 0);
+        f(j, indices[j] / 64, 1UL << (indices[j] % 64));
+    }
+}
+
+
+BitArray& BitArray::set_many(std::span<const std::uint64_t> indices, bool val)
+{
+    check_indices(indices, num_bits);
+    touch();
+    if (val)
+        for_each_index<true>(indices, words, [&](size_t, size_t w, unsigned long mask) { words[w] |= mask; });
+    else
+        for_each_index<true>(indices, words, [&](size_t, size_t w, unsigned long mask) { words[w] &= ~mask; });
+    return *this;
+}
+
+
+void BitArray::test_many(std::span<const std::uint64_t> indices, BitArray& out) const
+{
+    check_indices(indices, num_bits);
+    // out may alias *this, so gather into a fresh array first
+    BitArray result(indices.size(), out.get_allocator());
+    for_each_index<false>(indices, words, [&](size_t j, size_t w, unsigned long mask) {
+        if (words[w] & mask)
+            result.words[j / 64] |= 1UL << (j % 64);
+    });
+    out = std::move(result);
+}
+
+
+void BitArray::test_many(std::span<const std::uint64_t> indices, std::span<std::uint8_t> out) const
+{
+    if (out.size() < indices.size()) throw std::length_error("Buffer is too small");
+    check_indices(indices, num_bits);
+    for_each_index<false>(indices, words, [&](size_t j, size_t w, unsigned long mask) { out[j] = (words[w] & mask) != 0; });
+}
+
+
+size_t BitArray::count_hits(std::span<const std::uint64_t> indices) const
+{
+    check_indices(indices, num_bits);
+    size_t hits = 0;
+    for_each_index<false>(indices, words, [&](size_t, size_t w, unsigned long mask) { hits += (words[w] & mask) != 0; });
+    return hits;
+}
+
+
 bool BitArray::any() const {
-    for (unsigned long word : data)
-        if (word != 0) return true;
+    for (size_t i = 0; i < word_count(); ++i)
+        if (words[i] != 0) return true;
     return false;
 }
 
@@ -183,33 +644,28 @@ bool BitArray::none() const
 }
 
 
-BitArray BitArray::operator~() const 
+size_t BitArray::count() const 
 {
-    BitArray result(*this);
-    for (size_t i = 0; i < data.size(); ++i) 
-        result.data[i] = ~data[i];
-    return result;
+    return active_kernels().popcount(words, word_count());
 }
 
 
-int BitArray::count() const 
+bool BitArray::operator[](size_t i) const 
 {
-    int total = 0;
-    for (unsigned long word : data)
-        total += __builtin_popcountl(word);
-    return total;
+    if (i >= num_bits) 
+        throw std::out_of_range("Index out of bounds");
+    return (words[i / 64] >> (i % 64)) & 1;
 }
 
 
-bool BitArray::operator[](int i) const 
+void BitArray::clear_unused_bits()
 {
-    if (i < 0 || i >= num_bits) 
-        throw std::out_of_range("Index out of bounds");
-    return (data[i / 64] >> (i % 64)) & 1;
+    if (num_bits % 64 != 0)
+        words[word_count() - 1] &= (1UL << (num_bits % 64)) - 1;
 }
 
 
-int BitArray::size() const 
+size_t BitArray::size() const 
 {
     return num_bits;
 }
@@ -221,63 +677,298 @@ bool BitArray::empty() const
 }
 
 
+// Text and byte conversion
+
+// The eight characters of every byte value, most significant bit first
+static constexpr auto binary_digits = [] {
+    std::array<std::array<char, 8>, 256> table{};
+    for (size_t b = 0; b < 256; ++b)
+        for (size_t j = 0; j < 8; ++j)
+            table[b][j] = (b >> (7 - j)) & 1 ? '1' : '0';
+    return table;
+}();
+
+// The two hex digits of every byte value
+static constexpr auto hex_pairs = [] {
+    constexpr char digits[] = "0123456789abcdef";
+    std::array<std::array<char, 2>, 256> table{};
+    for (size_t b = 0; b < 256; ++b)
+        table[b] = {digits[b >> 4], digits[b & 15]};
+    return table;
+}();
+
+// Value of every character as a hex digit, -1 if it is not one
+static constexpr auto hex_values = [] {
+    std::array<signed char, 256> table{};
+    table.fill(-1);
+    for (int d = 0; d < 10; ++d)
+        table['0' + d] = static_cast<signed char>(d);
+    for (int d = 0; d < 6; ++d) {
+        table['a' + d] = static_cast<signed char>(10 + d);
+        table['A' + d] = static_cast<signed char>(10 + d);
+    }
+    return table;
+}();
+
+// Eight characters as one integer, the first in the low byte
+static std::uint64_t load_chars(const char* p)
+{
+    std::uint64_t chunk;
+    std::memcpy(&chunk, p, sizeof(chunk));
+    if constexpr (std::endian::native == std::endian::big)
+        chunk = __builtin_bswap64(chunk);
+    return chunk;
+}
+
+
+size_t BitArray::hex_size() const
+{
+    return (num_bits + 3) / 4;
+}
+
+
+size_t BitArray::byte_size() const
+{
+    return (num_bits + 7) / 8;
+}
+
+
+void BitArray::write_string(std::span<char> out) const
+{
+    if (out.size() < num_bits) throw std::length_error("Buffer is too small");
+
+    // Whole bytes fill the string from the end, eight characters per lookup;
+    // the top num_bits % 8 bits take the tail of one more entry
+    const size_t full_bytes = num_bits / 8;
+    char* end = out.data() + num_bits;
+    for (size_t k = 0; k < full_bytes; ++k)
+        std::memcpy(end - 8 * (k + 1), binary_digits[byte_at(k)].data(), 8);
+    if (const size_t rest = num_bits % 8; rest != 0)
+        std::memcpy(out.data(), binary_digits[byte_at(full_bytes)].data() + 8 - rest, rest);
+}
+
+
+void BitArray::write_hex(std::span<char> out) const
+{
+    const size_t digits = hex_size();
+    if (out.size() < digits) throw std::length_error("Buffer is too small");
+
+    char* end = out.data() + digits;
+    for (size_t k = 0; k < digits / 2; ++k)
+        std::memcpy(end - 2 * (k + 1), hex_pairs[byte_at(k)].data(), 2);
+    if (digits % 2 != 0)
+        out[0] = hex_pairs[byte_at(digits / 2)][1];
+}
+
+
+void BitArray::write_bytes(std::span<std::uint8_t> out) const
+{
+    const size_t n = byte_size();
+    if (out.size() < n) throw std::length_error("Buffer is too small");
+    if (n == 0)
+        return;
+
+    if constexpr (std::endian::native == std::endian::little) {
+        std::memcpy(out.data(), words, n);
+    } else {
+        for (size_t k = 0; k < n; ++k)
+            out[k] = byte_at(k);
+    }
+}
+
+
 std::string BitArray::to_string() const
 {
-    std::string result;
-    for (int i = num_bits - 1; i >= 0; --i)
-        result += (*this)[i] ? '1' : '0';
+    std::string result(num_bits, '0');
+    write_string(result);
     return result;
 }
 
 
-bool operator==(const BitArray& a, const BitArray& b) 
+std::string BitArray::to_hex() const
 {
-    return a.num_bits == b.num_bits && a.data == b.data;
+    std::string result(hex_size(), '0');
+    write_hex(result);
+    return result;
 }
 
 
-bool operator!=(const BitArray& a, const BitArray& b) 
+std::vector<std::uint8_t> BitArray::to_bytes() const
 {
-    return !(a == b);
+    std::vector<std::uint8_t> result(byte_size());
+    write_bytes(result);
+    return result;
 }
 
 
-BitArray operator&(const BitArray& b1, const BitArray& b2) 
+BitArray BitArray::from_string(std::string_view s)
 {
-    if (b1.num_bits != b2.num_bits) throw std::invalid_argument("Sizes must be equal");
-    
-    BitArray result(b1);
-    result &= b2;
+    BitArray result(s.size());
+
+    // Eight characters at a time from the end: subtract '0' from every byte,
+    // check that each is now 0 or 1, and gather them into one byte with a
+    // multiply that moves the first character to bit 7 and the last to bit 0
+    const size_t full_bytes = s.size() / 8;
+    const char* end = s.data() + s.size();
+    for (size_t k = 0; k < full_bytes; ++k) {
+        std::uint64_t chunk = load_chars(end - 8 * (k + 1)) - 0x3030303030303030ULL;
+        if ((chunk & ~0x0101010101010101ULL) != 0)
+            throw std::invalid_argument("String must hold only '0' and '1'");
+        result.words[k / 8] |= ((chunk * 0x8040201008040201ULL) >> 56) << (8 * (k % 8));
+    }
+
+    unsigned long top = 0;
+    for (size_t i = 0; i < s.size() % 8; ++i) {
+        if (s[i] != '0' && s[i] != '1')
+            throw std::invalid_argument("String must hold only '0' and '1'");
+        top = top << 1 | (s[i] - '0');
+    }
+    if (top != 0)
+        result.words[full_bytes / 8] |= top << (8 * (full_bytes % 8));
     return result;
 }
 
 
-BitArray operator|(const BitArray& b1, const BitArray& b2) 
+BitArray BitArray::from_hex(std::string_view hex, size_t num_bits)
 {
-    if (b1.num_bits != b2.num_bits) throw std::invalid_argument("Sizes must be equal");
-    
-    BitArray result(b1);
-    result |= b2;
+    const size_t digits = hex.size();
+    if (num_bits == npos)
+        num_bits = 4 * digits;
+    if ((num_bits + 3) / 4 != digits)
+        throw std::invalid_argument("Size does not match the number of digits");
+
+    BitArray result(num_bits);
+    for (size_t n = 0; n < digits; ++n) {  // n counts digits from the least significant
+        signed char value = hex_values[static_cast<unsigned char>(hex[digits - 1 - n])];
+        if (value < 0) throw std::invalid_argument("Invalid hex digit");
+        result.words[n / 16] |= static_cast<unsigned long>(value) << (4 * (n % 16));
+    }
+    if (num_bits % 4 != 0 && hex_values[static_cast<unsigned char>(hex[0])] >> (num_bits % 4) != 0)
+        throw std::invalid_argument("Digits do not fit in the size");
     return result;
 }
 
 
-BitArray operator^(const BitArray& b1, const BitArray& b2) 
+BitArray BitArray::from_bytes(std::span<const std::uint8_t> bytes, size_t num_bits)
 {
-    if (b1.num_bits != b2.num_bits) throw std::invalid_argument("Sizes must be equal");
-    
-    BitArray result(b1);
-    result ^= b2;
+    if (bytes.size() < (num_bits + 7) / 8) throw std::invalid_argument("Not enough bytes for the size");
+
+    BitArray result(num_bits);
+    const size_t n = (num_bits + 7) / 8;
+    if (n == 0)
+        return result;
+
+    if constexpr (std::endian::native == std::endian::little) {
+        std::memcpy(result.words, bytes.data(), n);
+    } else {
+        for (size_t k = 0; k < n; ++k)
+            result.words[k / 8] |= static_cast<unsigned long>(bytes[k]) << (8 * (k % 8));
+    }
+    result.clear_unused_bits();
     return result;
 }
 
 
-BitArray::Iterator::Iterator(const BitArray* ba, int idx) : bit_array(ba), index(idx) {}
+bool operator==(const BitArray& a, const BitArray& b) 
+{
+    return a.num_bits == b.num_bits && std::equal(a.words, a.words + a.word_count(), b.words);
+}
+
+
+bool operator!=(const BitArray& a, const BitArray& b) 
+{
+    return !(a == b);
+}
+
+
+std::strong_ordering operator<=>(const BitArray& a, const BitArray& b)
+{
+    const size_t common = std::min(a.num_bits, b.num_bits);
+    const size_t n = (common + 63) / 64;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned long diff = a.words[i] ^ b.words[i];
+        if (i + 1 == n)
+            diff &= last_word_mask(common);
+        // The lowest differing bit decides; the side holding a 1 there is greater
+        if (diff != 0)
+            return (a.words[i] >> __builtin_ctzl(diff)) & 1 ? std::strong_ordering::greater
+                                                            : std::strong_ordering::less;
+    }
+    return a.num_bits <=> b.num_bits;
+}
+
+
+BitArray operator&(BitArray&& a, const BitArray& b)
+{
+    a &= b;
+    return std::move(a);
+}
+
+
+BitArray operator|(BitArray&& a, const BitArray& b)
+{
+    a |= b;
+    return std::move(a);
+}
+
+
+BitArray operator^(BitArray&& a, const BitArray& b)
+{
+    a ^= b;
+    return std::move(a);
+}
+
+
+BitArray operator&(const BitArray& a, BitArray&& b)
+{
+    return std::move(b) & a;
+}
+
+
+BitArray operator|(const BitArray& a, BitArray&& b)
+{
+    return std::move(b) | a;
+}
+
+
+BitArray operator^(const BitArray& a, BitArray&& b)
+{
+    return std::move(b) ^ a;
+}
+
+
+BitArray operator&(BitArray&& a, BitArray&& b)
+{
+    return std::move(a) & static_cast<const BitArray&>(b);
+}
+
+
+BitArray operator|(BitArray&& a, BitArray&& b)
+{
+    return std::move(a) | static_cast<const BitArray&>(b);
+}
+
+
+BitArray operator^(BitArray&& a, BitArray&& b)
+{
+    return std::move(a) ^ static_cast<const BitArray&>(b);
+}
+
+
+BitArray operator~(BitArray&& a)
+{
+    a.flip();
+    return std::move(a);
+}
+
+
+BitArray::Iterator::Iterator(const BitArray* ba, size_t idx) : bit_array(ba), index(idx) {}
 
 
 bool BitArray::Iterator::operator*() const 
 {
-    return (*bit_array)[index];
+    // Iterators only walk [0, size()), so the bounds check of operator[] is not needed
+    return (bit_array->words[index / 64] >> (index % 64)) & 1;
 }
 
 
@@ -310,3 +1001,240 @@ BitArray::Iterator BitArray::end() const
 {
     return Iterator(this, num_bits);
 }
+
+
+size_t BitArray::find_first() const
+{
+    for (size_t i = 0; i < word_count(); ++i) {
+        unsigned long word = words[i];
+        if (word != 0)
+            return i * 64 + __builtin_ctzl(word);
+    }
+    return npos;
+}
+
+
+size_t BitArray::find_next(size_t i) const
+{
+    if (i >= num_bits) throw std::out_of_range("Index out of bounds");
+    if (i + 1 == num_bits)
+        return npos;
+
+    // Finish the word holding i, then skip whole zero words
+    size_t w = (i + 1) / 64;
+    unsigned long word = words[w] & (~0UL << ((i + 1) % 64));
+    while (word == 0) {
+        if (++w == word_count())
+            return npos;
+        word = words[w];
+    }
+    return w * 64 + __builtin_ctzl(word);
+}
+
+
+size_t BitArray::find_last() const
+{
+    for (size_t i = word_count(); i-- > 0;) {
+        unsigned long word = words[i];
+        if (word != 0)
+            return i * 64 + 63 - __builtin_clzl(word);
+    }
+    return npos;
+}
+
+
+// Parallel bulk operations
+
+// Splits a bulk operation into at most one chunk per thread, each a whole
+// number of cache lines
+struct ChunkPlan {
+    size_t num_words;
+    size_t chunk_words;
+    size_t chunks;
+};
+
+// Read once: glibc answers hardware_concurrency() from /sys, which costs microseconds
+static unsigned hardware_threads()
+{
+    static const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    return threads;
+}
+
+static ChunkPlan plan_chunks(size_t num_words, const ParallelPolicy& policy)
+{
+    size_t threads = policy.threads != 0 ? policy.threads : hardware_threads();
+    threads = std::min(threads, std::max<size_t>(1, num_words / std::max<size_t>(1, policy.min_words_per_thread)));
+
+    size_t chunk_words = (num_words + threads - 1) / threads;
+    chunk_words = (chunk_words + words_per_cache_line - 1) / words_per_cache_line * words_per_cache_line;
+    size_t chunks = chunk_words == 0 ? 0 : (num_words + chunk_words - 1) / chunk_words;
+    return {num_words, chunk_words, chunks};
+}
+
+// Worker threads shared by every parallel operation. They start on first use
+// and live until exit, so a call costs a queue push per chunk and a latch
+// wait instead of starting and joining threads. Waiting callers drain the
+// queue themselves, so chunks run even when the workers are all busy.
+class ChunkPool {
+public:
+    struct Task {
+        void (*run)(const void* job, size_t chunk);
+        const void* job;
+        size_t chunk;
+        std::latch* done;
+    };
+
+    static ChunkPool& instance()
+    {
+        // One worker per hardware thread besides the caller, and at least one
+        static ChunkPool pool(std::max(2u, hardware_threads()) - 1);
+        return pool;
+    }
+
+    void submit(const Task& task)
+    {
+        {
+            std::lock_guard lock(mutex);
+            tasks.push_back(task);
+        }
+        wake.notify_one();
+    }
+
+    // Runs one queued task on the calling thread; false when there is none
+    bool run_one()
+    {
+        Task task{};
+        {
+            std::lock_guard lock(mutex);
+            if (tasks.empty())
+                return false;
+            task = tasks.front();
+            tasks.pop_front();
+        }
+        execute(task);
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::deque<Task> tasks;
+    std::vector<std::jthread> workers;  // Last, so they are stopped and joined first
+
+    explicit ChunkPool(unsigned count)
+    {
+        for (unsigned i = 0; i < count; ++i)
+            workers.emplace_back([this](std::stop_token stop) { work(stop); });
+    }
+
+    static void execute(const Task& task)
+    {
+        task.run(task.job, task.chunk);
+        task.done->count_down();
+    }
+
+    void work(std::stop_token stop)
+    {
+        for (;;) {
+            Task task{};
+            {
+                std::unique_lock lock(mutex);
+                if (!wake.wait(lock, stop, [&] { return !tasks.empty(); }))
+                    return;
+                task = tasks.front();
+                tasks.pop_front();
+            }
+            execute(task);
+        }
+    }
+};
+
+// Runs f(chunk, first_word, last_word) for every chunk of the plan. The
+// calling thread takes the first chunk, the pool the others.
+template <typename F>
+static void run_chunks(const ChunkPlan& plan, F f)
+{
+    if (plan.chunks == 0)
+        return;
+
+    auto job = [&](size_t c) { f(c, c * plan.chunk_words, std::min((c + 1) * plan.chunk_words, plan.num_words)); };
+    auto run = [](const void* p, size_t c) { (*static_cast<const decltype(job)*>(p))(c); };
+
+    ChunkPool& pool = ChunkPool::instance();
+    std::latch done(static_cast<std::ptrdiff_t>(plan.chunks - 1));
+    for (size_t c = 1; c < plan.chunks; ++c)
+        pool.submit({run, &job, c, &done});
+    job(0);
+    while (!done.try_wait() && pool.run_one()) {}
+    done.wait();
+}
+
+
+size_t BitArray::count(const ParallelPolicy& policy) const
+{
+    ChunkPlan plan = plan_chunks(word_count(), policy);
+    std::vector<size_t> partial(plan.chunks);
+    run_chunks(plan, [&](size_t chunk, size_t first, size_t last) {
+        partial[chunk] = active_kernels().popcount(words + first, last - first);
+    });
+
+    size_t total = 0;
+    for (size_t ones : partial)
+        total += ones;
+    return total;
+}
+
+
+bool BitArray::any(const ParallelPolicy& policy) const
+{
+    // Workers scan in slices and stop as soon as any of them has found a set bit
+    static constexpr size_t slice_words = 4096;
+    std::atomic<bool> found{false};
+    run_chunks(plan_chunks(word_count(), policy), [&](size_t, size_t first, size_t last) {
+        for (size_t slice = first; slice < last && !found.load(std::memory_order_relaxed); slice += slice_words) {
+            for (size_t i = slice; i < std::min(slice + slice_words, last); ++i) {
+                if (words[i] != 0) {
+                    found.store(true, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        }
+    });
+    return found.load();
+}
+
+
+BitArray& BitArray::and_with(const BitArray& b, const ParallelPolicy& policy)
+{
+    if (num_bits != b.num_bits) throw std::invalid_argument("Sizes must be equal");
+
+    touch();
+    run_chunks(plan_chunks(word_count(), policy), [&](size_t, size_t first, size_t last) {
+        active_kernels().and_words(words + first, b.words + first, last - first);
+    });
+    return *this;
+}
+
+
+BitArray& BitArray::or_with(const BitArray& b, const ParallelPolicy& policy)
+{
+    if (num_bits != b.num_bits) throw std::invalid_argument("Sizes must be equal");
+
+    touch();
+    run_chunks(plan_chunks(word_count(), policy), [&](size_t, size_t first, size_t last) {
+        active_kernels().or_words(words + first, b.words + first, last - first);
+    });
+    return *this;
+}
+
+
+BitArray& BitArray::xor_with(const BitArray& b, const ParallelPolicy& policy)
+{
+    if (num_bits != b.num_bits) throw std::invalid_argument("Sizes must be equal");
+
+    touch();
+    run_chunks(plan_chunks(word_count(), policy), [&](size_t, size_t first, size_t last) {
+        active_kernels().xor_words(words + first, b.words + first, last - first);
+    });
+    return *this;
+}
@@ -2,70 +2,219 @@
 #define BITARRAY_H
 
 #include <iostream>
-#include <vector>
 #include <stdexcept>
 #include <algorithm>
 #include <string>
+#include <climits>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <type_traits>
+#include <span>
+#include <string_view>
+#include <vector>
+
+class BitArray;
+
+// How to split a bulk operation across threads (see BitArray::count(const ParallelPolicy&))
+struct ParallelPolicy {
+    unsigned threads = 0;  // 0 means std::thread::hardware_concurrency()
+    // Smaller arrays use fewer threads. 128 KiB per thread is about 2 us of
+    // popcount, several times the pool's dispatch cost (see ParallelCount in
+    // bitarray_bench)
+    size_t min_words_per_thread = size_t(1) << 14;
+};
+
+// Marks the types that can appear in a lazy bitwise expression: BitArray
+// itself and the expression nodes defined below.
+template <typename T>
+struct is_bit_expression : std::false_type {};
+
+template <>
+struct is_bit_expression<BitArray> : std::true_type {};
+
+template <typename T>
+concept BitExpression = is_bit_expression<std::remove_cvref_t<T>>::value;
+
+template <typename T>
+concept BitExpressionNode = BitExpression<T> && !std::is_same_v<std::remove_cvref_t<T>, BitArray>;
 
 class BitArray {
 private:
-    int num_bits;  // Total number of bits in the array
-    std::vector<unsigned long> data;  // Storage for the bits
+    static constexpr size_t inline_capacity = 2;  // Words kept inside the object before spilling to the heap
+
+    size_t num_bits;  // Total number of bits in the array
+    unsigned long* words;  // Storage for the bits: inline_words or a heap block
+    size_t capacity_words;  // Number of words words can hold
+    std::pmr::memory_resource* resource;  // Source of heap blocks; inline storage never uses it
+    unsigned long inline_words[inline_capacity];  // Small-buffer storage
+    unsigned long generation_counter = 0;  // Bumped by every mutation, see generation()
+
+    void reallocate(size_t new_capacity);  // Move the used words into a buffer of exactly new_capacity words
+    void grow(size_t min_capacity);  // Geometric growth up to at least min_capacity words
+    void release();  // Free the heap block, if any, and fall back to inline storage
+    void steal(BitArray& b) noexcept;  // Take over b's storage, which our resource must be able to free
+    void copy_across(BitArray& b);  // Copy b into our resource and empty it
+    void clear_unused_bits();  // Zero the bits of the last word past num_bits; every mutation ends with them zero
+    void touch() { ++generation_counter; }  // Record a mutation
+    [[nodiscard]] std::uint8_t byte_at(size_t k) const  // Bits 8k..8k+7
+    {
+        return static_cast<std::uint8_t>(words[k / 8] >> (8 * (k % 8)));
+    }
 
 public:
+    // Heap blocks come from a std::pmr::memory_resource, the default resource
+    // unless one is given. Declaring allocator_type lets pmr containers pass
+    // their resource on, so a std::pmr::vector<BitArray> keeps everything in
+    // one arena.
+    using allocator_type = std::pmr::polymorphic_allocator<unsigned long>;
+
+    static constexpr size_t npos = static_cast<size_t>(-1);  // Returned by the find_* functions when there is no set bit
+
+    // Largest size, in bits. Sizes, indices and shifts are size_t; code passing
+    // int still compiles, and a negative int wraps past max_size() and is
+    // rejected with the same exception as before.
+    static constexpr size_t max_size() { return PTRDIFF_MAX; }
+
     // Constructors and destructor
     BitArray();
     ~BitArray();
-    explicit BitArray(int num_bits, unsigned long value = 0);
-    BitArray(const BitArray& b);
+    explicit BitArray(size_t num_bits, unsigned long value = 0);
+    BitArray(const BitArray& b);  // The copy uses the default resource, like the pmr containers
+    BitArray(BitArray&& b) noexcept;  // Steals the heap block and its resource; b is left empty
+    explicit BitArray(const allocator_type& alloc);
+    BitArray(size_t num_bits, const allocator_type& alloc);
+    BitArray(size_t num_bits, unsigned long value, const allocator_type& alloc);
+    BitArray(const BitArray& b, const allocator_type& alloc);
+    BitArray(BitArray&& b, const allocator_type& alloc);  // Copies when alloc's resource differs from b's
+    template <BitExpressionNode E>
+    BitArray(const E& expr);  // Evaluates a lazy expression in one pass
         
     // Friend functions
     friend bool operator==(const BitArray &a, const BitArray &b);
     friend bool operator!=(const BitArray &a, const BitArray &b);
-    friend BitArray operator&(const BitArray& b1, const BitArray& b2);
-    friend BitArray operator|(const BitArray& b1, const BitArray& b2);
-    friend BitArray operator^(const BitArray& b1, const BitArray& b2);
+    // Lexicographic by bit index, like std::vector<bool>: the first differing
+    // bit decides, and a proper prefix orders first
+    friend std::strong_ordering operator<=>(const BitArray &a, const BitArray &b);
 
     // Member functions
-    void swap(BitArray& b);
+    void swap(BitArray& b) noexcept;  // Precondition: the memory resources are equal
+    [[nodiscard]] allocator_type get_allocator() const;
+    // Hash of the size and the words; equal arrays hash equal because the
+    // bits past size() are always zero
+    [[nodiscard]] size_t hash() const noexcept;
     BitArray& operator=(const BitArray& b);
-    void resize(int num_bits, bool value = false);
+    // Both assignments keep this array's resource; a move from an array with
+    // another resource copies, since its block cannot be freed through ours.
+    // That copy is the one move that allocates: if it fails, std::terminate
+    BitArray& operator=(BitArray&& b) noexcept;
+    template <BitExpressionNode E>
+    BitArray& operator=(const E& expr);
+    void resize(size_t num_bits, bool value = false);
+    void reserve(size_t capacity_bits);
+    void shrink_to_fit();
+    [[nodiscard]] size_t capacity() const;
     void clear();
     void push_back(bool bit);
 
     // Utility functions
     [[nodiscard]] bool any() const;
     [[nodiscard]] bool none() const;
-    BitArray operator~() const;
-    [[nodiscard]] int count() const;
-    bool operator[](int i) const;
-    [[nodiscard]] int size() const;
+    [[nodiscard]] bool any(const ParallelPolicy& policy) const;  // Stops early on every thread
+    [[nodiscard]] size_t count() const;
+    [[nodiscard]] size_t count(const ParallelPolicy& policy) const;
+    bool operator[](size_t i) const;
+    [[nodiscard]] size_t size() const;
     [[nodiscard]] bool empty() const;
-    [[nodiscard]] std::string to_string() const;
+    [[nodiscard]] std::string to_string() const;  // Most significant bit first
+
+    // Bulk conversions. Hex is lowercase with the most significant digit
+    // first; bytes are little-endian, bit i being bit i % 8 of byte i / 8.
+    // The write_* versions fill a caller buffer of at least size(),
+    // hex_size() or byte_size() elements and throw std::length_error otherwise.
+    [[nodiscard]] std::string to_hex() const;
+    [[nodiscard]] std::vector<std::uint8_t> to_bytes() const;
+    void write_string(std::span<char> out) const;
+    void write_hex(std::span<char> out) const;
+    void write_bytes(std::span<std::uint8_t> out) const;
+    [[nodiscard]] size_t hex_size() const;
+    [[nodiscard]] size_t byte_size() const;
+
+    // Parsers for the same formats; malformed input throws std::invalid_argument
+    static BitArray from_string(std::string_view s);
+    static BitArray from_hex(std::string_view hex, size_t num_bits = npos);  // npos: four bits per digit
+    static BitArray from_bytes(std::span<const std::uint8_t> bytes, size_t num_bits);
+
+    // Word access used by expression evaluation; bits past size() in the last word are zero
+    [[nodiscard]] size_t word_count() const;
+    [[nodiscard]] unsigned long word(size_t i) const { return words[i]; }
+
+    // Raw word storage: bit i is bit i % 64 of word i / 64. Code writing through
+    // data() must leave the bits past size() in the last word zero.
+    [[nodiscard]] const unsigned long* data() const { return words; }
+    [[nodiscard]] unsigned long* data() { touch(); return words; }
+
+    // Changes whenever the contents change; lets derived indexes (RankSelect) detect staleness
+    [[nodiscard]] unsigned long generation() const { return generation_counter; }
     
         // Bit manipulation functions
-    BitArray& set(int n, bool val = true);
+    BitArray& set(size_t n, bool val = true);
     BitArray& set();
-    BitArray& reset(int n);
+    BitArray& reset(size_t n);
     BitArray& reset();
+    BitArray& flip();  // Inverts every bit in place
+
+    // The same over the bits in [first, last), first <= last <= size(); only
+    // the two boundary words are masked, whole words in between are filled,
+    // inverted or counted in bulk
+    BitArray& set_range(size_t first, size_t last, bool val = true);
+    BitArray& reset_range(size_t first, size_t last);
+    BitArray& flip_range(size_t first, size_t last);
+    size_t count_range(size_t first, size_t last) const;
+
+    // Batched access to a list of indices. The indices are validated in one
+    // pass, then visited in order with the words of upcoming ones prefetched.
+    // test_many writes bit j (byte j) of out for indices[j]; out is resized
+    // to indices.size() bits or must hold that many bytes. count_hits counts
+    // the indices whose bit is set, duplicates included.
+    BitArray& set_many(std::span<const std::uint64_t> indices, bool val = true);
+    void test_many(std::span<const std::uint64_t> indices, BitArray& out) const;
+    void test_many(std::span<const std::uint64_t> indices, std::span<std::uint8_t> out) const;
+    size_t count_hits(std::span<const std::uint64_t> indices) const;
 
     // Bitwise operators
     BitArray& operator&=(const BitArray& b);
     BitArray& operator|=(const BitArray& b);
     BitArray& operator^=(const BitArray& b);
-    BitArray& operator<<=(int n);
-    BitArray& operator>>=(int n);
-    BitArray operator<<(int n) const;
-    BitArray operator>>(int n) const;
+    template <BitExpressionNode E>
+    BitArray& operator&=(const E& expr);
+    template <BitExpressionNode E>
+    BitArray& operator|=(const E& expr);
+    template <BitExpressionNode E>
+    BitArray& operator^=(const E& expr);
+    // Parallel versions of &=, |= and ^= for very large arrays
+    BitArray& and_with(const BitArray& b, const ParallelPolicy& policy);
+    BitArray& or_with(const BitArray& b, const ParallelPolicy& policy);
+    BitArray& xor_with(const BitArray& b, const ParallelPolicy& policy);
+    BitArray& operator<<=(size_t n);
+    BitArray& operator>>=(size_t n);
+    BitArray operator<<(size_t n) const&;
+    BitArray operator>>(size_t n) const&;
+    BitArray operator<<(size_t n) &&;  // Shifts a temporary in place
+    BitArray operator>>(size_t n) &&;
+    BitArray& rotate_left(size_t n);
+    BitArray& rotate_right(size_t n);
 
     // Iterator class for range-based for loops
     class Iterator {
     private:
         const BitArray* bit_array;  // Pointer to the BitArray
-        int index;  // Current index in the BitArray
+        size_t index;  // Current index in the BitArray
 
     public:
-        Iterator(const BitArray* ba, int idx);
+        Iterator(const BitArray* ba, size_t idx);
         bool operator*() const;
         Iterator& operator++();
         bool operator!=(const Iterator& other) const;
@@ -75,12 +224,348 @@ public:
     // Methods for iterator support
     Iterator begin() const;
     Iterator end() const;
+
+    // Set-bit search, skipping zero words
+    [[nodiscard]] size_t find_first() const;
+    size_t find_next(size_t i) const;  // First set bit after position i
+    [[nodiscard]] size_t find_last() const;
+
+    // Iterator over the indices of the set bits, in increasing order
+    class SetBitIterator {
+    private:
+        const BitArray* bit_array;
+        size_t word_index;  // Word being scanned, word_count() at the end
+        unsigned long remaining;  // Bits of that word not visited yet
+
+    public:
+        SetBitIterator(const BitArray* ba, size_t word_idx) : bit_array(ba), word_index(word_idx), remaining(0)
+        {
+            if (word_index < bit_array->word_count()) {
+                remaining = bit_array->words[word_index];
+                skip_empty_words();
+            }
+        }
+
+        size_t operator*() const { return word_index * 64 + __builtin_ctzl(remaining); }
+
+        SetBitIterator& operator++()
+        {
+            remaining &= remaining - 1;
+            skip_empty_words();
+            return *this;
+        }
+
+        bool operator==(const SetBitIterator& other) const
+        {
+            return word_index == other.word_index && remaining == other.remaining;
+        }
+        bool operator!=(const SetBitIterator& other) const { return !(*this == other); }
+
+    private:
+        void skip_empty_words()
+        {
+            const size_t n = bit_array->word_count();
+            while (remaining == 0 && ++word_index < n)
+                remaining = bit_array->words[word_index];
+            if (remaining == 0)
+                word_index = n;
+        }
+    };
+
+    struct SetBitRange {
+        const BitArray* bit_array;
+        SetBitIterator begin() const { return SetBitIterator(bit_array, 0); }
+        SetBitIterator end() const { return SetBitIterator(bit_array, bit_array->word_count()); }
+    };
+
+    // for (size_t i : ba.set_bits()) visits every set bit
+    [[nodiscard]] SetBitRange set_bits() const { return SetBitRange{this}; }
 };
 
 bool operator==(const BitArray &a, const BitArray &b);
 bool operator!=(const BitArray &a, const BitArray &b);
-BitArray operator&(const BitArray& b1, const BitArray& b2);
-BitArray operator|(const BitArray& b1, const BitArray& b2);
-BitArray operator^(const BitArray& b1, const BitArray& b2);
+std::strong_ordering operator<=>(const BitArray &a, const BitArray &b);
+
+// wyhash-style hash of the n words of an array of num_bits bits, two words
+// per 128-bit multiply. Shared with FixedBitArray so equal contents hash
+// equal; the tail past num_bits must already be zero.
+constexpr size_t hash_bit_words(const unsigned long* words, size_t n, size_t num_bits) noexcept
+{
+    // The 128-bit product of two words, folded to 64 bits
+    auto mum = [](std::uint64_t a, std::uint64_t b) {
+        const unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+        return static_cast<std::uint64_t>(r) ^ static_cast<std::uint64_t>(r >> 64);
+    };
+
+    std::uint64_t seed = num_bits ^ 0xa0761d6478bd642fULL;
+    size_t i = 0;
+    for (; i + 1 < n; i += 2)
+        seed = mum(words[i] ^ 0xe7037ed1a0b428dbULL, words[i + 1] ^ seed);
+    if (i < n)
+        seed = mum(words[i] ^ 0xe7037ed1a0b428dbULL, seed ^ 0x8ebc6af09c88c6e3ULL);
+    return mum(seed ^ 0x589965cc75374cc3ULL, num_bits ^ 0x1d8e4e27c47d124fULL);
+}
+
+template <>
+struct std::hash<BitArray> {
+    size_t operator()(const BitArray& b) const noexcept { return b.hash(); }
+};
+
+
+// Lazy bitwise expressions.
+// a & b, a | b, a ^ b and ~a build small nodes instead of temporaries; the
+// words are computed one at a time when the expression is assigned to a
+// BitArray or reduced with count()/any(), so (a & b) | ~c is a single pass
+// with no intermediate allocation. Operators on BitArray temporaries are
+// eager (see below), so a node only ever refers to named arrays.
+//
+// A node is a view, not a value: `auto e = a & b;` reads a and b again on
+// every use, sees later changes to them and dangles once either is gone.
+// Write `BitArray e = a & b;` (or `(a & b).eval()`) to keep the result.
+// operator[] and to_string() work on nodes directly, for quick checks.
+
+// Operands are held by reference when they are BitArrays and by value when they are nodes
+template <typename T>
+using bit_operand_t = std::conditional_t<std::is_same_v<T, BitArray>, const BitArray&, T>;
+
+struct BitAndOp {
+    static unsigned long apply(unsigned long a, unsigned long b) { return a & b; }
+};
+
+struct BitOrOp {
+    static unsigned long apply(unsigned long a, unsigned long b) { return a | b; }
+};
+
+struct BitXorOp {
+    static unsigned long apply(unsigned long a, unsigned long b) { return a ^ b; }
+};
+
+// Mask of the bits of the last word that belong to an array of num_bits bits
+constexpr unsigned long last_word_mask(size_t num_bits)
+{
+    return num_bits % 64 == 0 ? ~0UL : (1UL << (num_bits % 64)) - 1;
+}
+
+
+// Members shared by the expression nodes. The reductions walk the operands
+// once without materializing the result: count(a ^ b) is the Hamming
+// distance. count() and any() are also hidden friends, found only for nodes,
+// so they do not clash with std::count; under `using namespace std` the name
+// any is the class std::any, so write (a & b).any() there.
+template <typename Derived>
+class BitExprBase {
+private:
+    const Derived& self() const { return static_cast<const Derived&>(*this); }
+
+public:
+    [[nodiscard]] BitArray eval() const { return BitArray(self()); }
+    [[nodiscard]] std::string to_string() const { return eval().to_string(); }
+
+    // Computes only the word that holds bit i
+    [[nodiscard]] bool operator[](size_t i) const
+    {
+        if (i >= self().size())
+            throw std::out_of_range("Index out of bounds");
+        return (self().word(i / 64) >> (i % 64)) & 1;
+    }
+
+    [[nodiscard]] size_t count() const
+    {
+        const size_t n = self().word_count();
+        if (n == 0)
+            return 0;
+
+        size_t total = 0;
+        for (size_t i = 0; i + 1 < n; ++i)
+            total += __builtin_popcountl(self().word(i));
+        return total + __builtin_popcountl(self().word(n - 1) & last_word_mask(self().size()));
+    }
+
+    [[nodiscard]] bool any() const
+    {
+        const size_t n = self().word_count();
+        if (n == 0)
+            return false;
+
+        for (size_t i = 0; i + 1 < n; ++i)
+            if (self().word(i) != 0) return true;
+        return (self().word(n - 1) & last_word_mask(self().size())) != 0;
+    }
+
+    [[nodiscard]] bool none() const { return !any(); }
+
+    friend size_t count(const Derived& expr) { return expr.count(); }
+    friend bool any(const Derived& expr) { return expr.any(); }
+};
+
+template <typename Op, typename L, typename R>
+class BitBinaryExpr : public BitExprBase<BitBinaryExpr<Op, L, R>> {
+private:
+    bit_operand_t<L> lhs;
+    bit_operand_t<R> rhs;
+
+public:
+    BitBinaryExpr(const L& l, const R& r) : lhs(l), rhs(r)
+    {
+        if (l.size() != r.size()) throw std::invalid_argument("Sizes must be equal");
+    }
+
+    [[nodiscard]] size_t size() const { return lhs.size(); }
+    [[nodiscard]] size_t word_count() const { return lhs.word_count(); }
+    [[nodiscard]] unsigned long word(size_t i) const { return Op::apply(lhs.word(i), rhs.word(i)); }
+};
+
+template <typename E>
+class BitNotExpr : public BitExprBase<BitNotExpr<E>> {
+private:
+    bit_operand_t<E> operand;
+
+public:
+    explicit BitNotExpr(const E& e) : operand(e) {}
+
+    [[nodiscard]] size_t size() const { return operand.size(); }
+    [[nodiscard]] size_t word_count() const { return operand.word_count(); }
+    [[nodiscard]] unsigned long word(size_t i) const { return ~operand.word(i); }
+};
+
+template <typename Op, typename L, typename R>
+struct is_bit_expression<BitBinaryExpr<Op, L, R>> : std::true_type {};
+
+template <typename E>
+struct is_bit_expression<BitNotExpr<E>> : std::true_type {};
+
+
+template <BitExpression L, BitExpression R>
+BitBinaryExpr<BitAndOp, L, R> operator&(const L& l, const R& r)
+{
+    return {l, r};
+}
+
+template <BitExpression L, BitExpression R>
+BitBinaryExpr<BitOrOp, L, R> operator|(const L& l, const R& r)
+{
+    return {l, r};
+}
+
+template <BitExpression L, BitExpression R>
+BitBinaryExpr<BitXorOp, L, R> operator^(const L& l, const R& r)
+{
+    return {l, r};
+}
+
+template <BitExpression E>
+BitNotExpr<E> operator~(const E& e)
+{
+    return BitNotExpr<E>(e);
+}
+
+
+// Operators on a BitArray temporary compute into its buffer instead of
+// building a lazy node, so chains like ~(a << 3) & b allocate only once
+BitArray operator&(BitArray&& a, const BitArray& b);
+BitArray operator|(BitArray&& a, const BitArray& b);
+BitArray operator^(BitArray&& a, const BitArray& b);
+BitArray operator&(const BitArray& a, BitArray&& b);
+BitArray operator|(const BitArray& a, BitArray&& b);
+BitArray operator^(const BitArray& a, BitArray&& b);
+BitArray operator&(BitArray&& a, BitArray&& b);
+BitArray operator|(BitArray&& a, BitArray&& b);
+BitArray operator^(BitArray&& a, BitArray&& b);
+BitArray operator~(BitArray&& a);
+
+template <BitExpressionNode E>
+BitArray operator&(BitArray&& a, const E& e)
+{
+    a &= e;
+    return std::move(a);
+}
+
+template <BitExpressionNode E>
+BitArray operator|(BitArray&& a, const E& e)
+{
+    a |= e;
+    return std::move(a);
+}
+
+template <BitExpressionNode E>
+BitArray operator^(BitArray&& a, const E& e)
+{
+    a ^= e;
+    return std::move(a);
+}
+
+template <BitExpressionNode E>
+BitArray operator&(const E& e, BitArray&& a)
+{
+    a &= e;
+    return std::move(a);
+}
+
+template <BitExpressionNode E>
+BitArray operator|(const E& e, BitArray&& a)
+{
+    a |= e;
+    return std::move(a);
+}
+
+template <BitExpressionNode E>
+BitArray operator^(const E& e, BitArray&& a)
+{
+    a ^= e;
+    return std::move(a);
+}
+
+
+template <BitExpressionNode E>
+BitArray::BitArray(const E& expr) : BitArray()
+{
+    *this = expr;
+}
+
+template <BitExpressionNode E>
+BitArray& BitArray::operator=(const E& expr)
+{
+    // Operands that alias *this have the same size, so no reallocation happens
+    // under them, and word i of the result only reads word i of the operands
+    touch();
+    if (num_bits != expr.size())
+        resize(expr.size());
+    for (size_t i = 0; i < word_count(); ++i)
+        words[i] = expr.word(i);
+    clear_unused_bits();
+    return *this;
+}
+
+template <BitExpressionNode E>
+BitArray& BitArray::operator&=(const E& expr)
+{
+    if (num_bits != expr.size()) throw std::invalid_argument("Sizes must be equal");
+    touch();
+    for (size_t i = 0; i < word_count(); ++i)
+        words[i] &= expr.word(i);
+    return *this;
+}
+
+template <BitExpressionNode E>
+BitArray& BitArray::operator|=(const E& expr)
+{
+    if (num_bits != expr.size()) throw std::invalid_argument("Sizes must be equal");
+    touch();
+    for (size_t i = 0; i < word_count(); ++i)
+        words[i] |= expr.word(i);
+    clear_unused_bits();
+    return *this;
+}
+
+template <BitExpressionNode E>
+BitArray& BitArray::operator^=(const E& expr)
+{
+    if (num_bits != expr.size()) throw std::invalid_argument("Sizes must be equal");
+    touch();
+    for (size_t i = 0; i < word_count(); ++i)
+        words[i] ^= expr.word(i);
+    clear_unused_bits();
+    return *this;
+}
 
 #endif // BITARRAY_H
@@ -0,0 +1,461 @@
+#include "bitarray.h"
+#include "bitarray_kernels.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <bitset>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef BITARRAY_BENCH_BOOST
+#include <boost/dynamic_bitset.hpp>
+#endif
+
+
+static std::vector<unsigned long> random_words(size_t n, unsigned seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<unsigned long> result(n);
+    for (unsigned long& word : result)
+        word = rng();
+    return result;
+}
+
+
+// Word kernels: scalar reference against every SIMD set the CPU supports
+
+static void BM_KernelPopcount(benchmark::State& state, const BitKernels* kernels)
+{
+    auto src = random_words(state.range(0), 1);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(kernels->popcount(src.data(), src.size()));
+    state.SetBytesProcessed(state.iterations() * src.size() * sizeof(unsigned long));
+}
+
+
+static void BM_KernelAnd(benchmark::State& state, const BitKernels* kernels)
+{
+    auto dst = random_words(state.range(0), 1);
+    auto src = random_words(state.range(0), 2);
+    for (auto _ : state) {
+        kernels->and_words(dst.data(), src.data(), dst.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * dst.size() * sizeof(unsigned long));
+}
+
+
+static void BM_KernelXor(benchmark::State& state, const BitKernels* kernels)
+{
+    auto dst = random_words(state.range(0), 1);
+    auto src = random_words(state.range(0), 2);
+    for (auto _ : state) {
+        kernels->xor_words(dst.data(), src.data(), dst.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * dst.size() * sizeof(unsigned long));
+}
+
+
+static void BM_KernelNot(benchmark::State& state, const BitKernels* kernels)
+{
+    auto src = random_words(state.range(0), 1);
+    std::vector<unsigned long> dst(src.size());
+    for (auto _ : state) {
+        kernels->not_words(dst.data(), src.data(), src.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * src.size() * sizeof(unsigned long));
+}
+
+
+static void BM_KernelTranspose(benchmark::State& state, const BitKernels* kernels)
+{
+    auto tile = random_words(64, 1);
+    for (auto _ : state) {
+        kernels->transpose_tile(tile.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * tile.size() * sizeof(unsigned long));
+}
+
+
+
+// Containers: BitArray against std::bitset, std::vector<bool> and
+// boost::dynamic_bitset. Each adapter exposes the same operations the way a
+// user of that container would write them; sizes are multiples of 64.
+
+struct BitArrayOps {
+    using Type = BitArray;
+    static constexpr bool growable = true;
+
+    static std::unique_ptr<Type> make(size_t n) { return std::make_unique<Type>(n); }
+    static void fill(Type& c, const std::vector<unsigned long>& words)
+    {
+        std::copy(words.begin(), words.end(), c.data());
+    }
+    static void push_back(Type& c, bool bit) { c.push_back(bit); }
+    static void resize(Type& c, size_t n, bool value) { c.resize(n, value); }
+    static void shift_left(Type& c, size_t k) { c <<= k; }
+    static void shift_right(Type& c, size_t k) { c >>= k; }
+    static void and_assign(Type& a, const Type& b) { a &= b; }
+    static void xor_assign(Type& a, const Type& b) { a ^= b; }
+    static void flip(Type& c) { c.flip(); }
+    static size_t count(const Type& c) { return c.count(); }
+    static size_t sum_set_bits(const Type& c)
+    {
+        size_t sum = 0;
+        for (size_t i : c.set_bits())
+            sum += i;
+        return sum;
+    }
+    static std::string to_string(const Type& c) { return c.to_string(); }
+};
+
+
+struct VectorBoolOps {
+    using Type = std::vector<bool>;
+    static constexpr bool growable = true;
+
+    static std::unique_ptr<Type> make(size_t n) { return std::make_unique<Type>(n); }
+    static void fill(Type& c, const std::vector<unsigned long>& words)
+    {
+        for (size_t i = 0; i < c.size(); ++i)
+            c[i] = (words[i / 64] >> (i % 64)) & 1;
+    }
+    static void push_back(Type& c, bool bit) { c.push_back(bit); }
+    static void resize(Type& c, size_t n, bool value) { c.resize(n, value); }
+    static void shift_left(Type& c, size_t k)
+    {
+        std::copy_backward(c.begin(), c.end() - k, c.end());
+        std::fill(c.begin(), c.begin() + k, false);
+    }
+    static void shift_right(Type& c, size_t k)
+    {
+        std::copy(c.begin() + k, c.end(), c.begin());
+        std::fill(c.end() - k, c.end(), false);
+    }
+    static void and_assign(Type& a, const Type& b)
+    {
+        for (size_t i = 0; i < a.size(); ++i)
+            a[i] = a[i] && b[i];
+    }
+    static void xor_assign(Type& a, const Type& b)
+    {
+        for (size_t i = 0; i < a.size(); ++i)
+            a[i] = a[i] != b[i];
+    }
+    static void flip(Type& c) { c.flip(); }
+    static size_t count(const Type& c) { return std::count(c.begin(), c.end(), true); }
+    static size_t sum_set_bits(const Type& c)
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i < c.size(); ++i)
+            if (c[i])
+                sum += i;
+        return sum;
+    }
+    static std::string to_string(const Type& c)
+    {
+        std::string s(c.size(), '0');
+        for (size_t i = 0; i < c.size(); ++i)
+            if (c[i])
+                s[c.size() - 1 - i] = '1';
+        return s;
+    }
+};
+
+
+// std::bitset has its size fixed at compile time; it is allocated on the
+// heap because the large ones do not fit on the stack
+template <size_t N>
+struct BitsetOps {
+    using Type = std::bitset<N>;
+    static constexpr bool growable = false;
+
+    static std::unique_ptr<Type> make(size_t) { return std::make_unique<Type>(); }
+    static void fill(Type& c, const std::vector<unsigned long>& words)
+    {
+        for (size_t i = 0; i < N; ++i)
+            c[i] = (words[i / 64] >> (i % 64)) & 1;
+    }
+    static void shift_left(Type& c, size_t k) { c <<= k; }
+    static void shift_right(Type& c, size_t k) { c >>= k; }
+    static void and_assign(Type& a, const Type& b) { a &= b; }
+    static void xor_assign(Type& a, const Type& b) { a ^= b; }
+    static void flip(Type& c) { c.flip(); }
+    static size_t count(const Type& c) { return c.count(); }
+    static size_t sum_set_bits(const Type& c)
+    {
+#if defined(__GLIBCXX__)
+        size_t sum = 0;
+        for (size_t i = c._Find_first(); i < N; i = c._Find_next(i))
+            sum += i;
+        return sum;
+#else
+        size_t sum = 0;
+        for (size_t i = 0; i < N; ++i)
+            if (c[i])
+                sum += i;
+        return sum;
+#endif
+    }
+    static std::string to_string(const Type& c) { return c.to_string(); }
+};
+
+
+#ifdef BITARRAY_BENCH_BOOST
+struct DynamicBitsetOps {
+    using Type = boost::dynamic_bitset<unsigned long>;
+    static constexpr bool growable = true;
+
+    static std::unique_ptr<Type> make(size_t n) { return std::make_unique<Type>(n); }
+    static void fill(Type& c, const std::vector<unsigned long>& words)
+    {
+        boost::from_block_range(words.begin(), words.end(), c);
+    }
+    static void push_back(Type& c, bool bit) { c.push_back(bit); }
+    static void resize(Type& c, size_t n, bool value) { c.resize(n, value); }
+    static void shift_left(Type& c, size_t k) { c <<= k; }
+    static void shift_right(Type& c, size_t k) { c >>= k; }
+    static void and_assign(Type& a, const Type& b) { a &= b; }
+    static void xor_assign(Type& a, const Type& b) { a ^= b; }
+    static void flip(Type& c) { c.flip(); }
+    static size_t count(const Type& c) { return c.count(); }
+    static size_t sum_set_bits(const Type& c)
+    {
+        size_t sum = 0;
+        for (size_t i = c.find_first(); i != Type::npos; i = c.find_next(i))
+            sum += i;
+        return sum;
+    }
+    static std::string to_string(const Type& c)
+    {
+        std::string s;
+        boost::to_string(c, s);
+        return s;
+    }
+};
+#endif
+
+
+template <typename Ops>
+static std::unique_ptr<typename Ops::Type> random_container(size_t n, unsigned seed)
+{
+    auto c = Ops::make(n);
+    Ops::fill(*c, random_words(n / 64, seed));
+    return c;
+}
+
+
+template <typename Ops>
+static void BM_Construct(benchmark::State& state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Ops::make(state.range(0)));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+template <typename Ops>
+static void BM_PushBack(benchmark::State& state)
+{
+    for (auto _ : state) {
+        auto c = Ops::make(0);
+        for (int64_t i = 0; i < state.range(0); ++i)
+            Ops::push_back(*c, i & 1);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+// Grow to n set bits, then shrink back to half
+template <typename Ops>
+static void BM_Resize(benchmark::State& state)
+{
+    for (auto _ : state) {
+        auto c = Ops::make(0);
+        Ops::resize(*c, state.range(0), true);
+        Ops::resize(*c, state.range(0) / 2, false);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+// Odd shift amounts, so no container gets a whole-word fast path
+template <typename Ops>
+static void BM_Shift(benchmark::State& state)
+{
+    auto c = random_container<Ops>(state.range(0), 1);
+    for (auto _ : state) {
+        Ops::shift_left(*c, 13);
+        Ops::shift_right(*c, 7);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+template <typename Ops>
+static void BM_And(benchmark::State& state)
+{
+    auto a = random_container<Ops>(state.range(0), 1);
+    auto b = random_container<Ops>(state.range(0), 2);
+    for (auto _ : state) {
+        Ops::and_assign(*a, *b);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+template <typename Ops>
+static void BM_Xor(benchmark::State& state)
+{
+    auto a = random_container<Ops>(state.range(0), 1);
+    auto b = random_container<Ops>(state.range(0), 2);
+    for (auto _ : state) {
+        Ops::xor_assign(*a, *b);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+template <typename Ops>
+static void BM_Flip(benchmark::State& state)
+{
+    auto c = random_container<Ops>(state.range(0), 1);
+    for (auto _ : state) {
+        Ops::flip(*c);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+template <typename Ops>
+static void BM_Count(benchmark::State& state)
+{
+    auto c = random_container<Ops>(state.range(0), 1);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Ops::count(*c));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+// Visits every set bit of a random array (about half of them)
+template <typename Ops>
+static void BM_IterateSetBits(benchmark::State& state)
+{
+    auto c = random_container<Ops>(state.range(0), 1);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Ops::sum_set_bits(*c));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+template <typename Ops>
+static void BM_ToString(benchmark::State& state)
+{
+    auto c = random_container<Ops>(state.range(0), 1);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Ops::to_string(*c));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+
+// Parallel count of range(0) words against the serial one. The pooled run
+// splits every size into one chunk per hardware thread (at least two, so the
+// pool's dispatch cost shows even on one core); the size where it starts to
+// win, divided by the thread count, is the right
+// ParallelPolicy::min_words_per_thread.
+static void BM_ParallelCount(benchmark::State& state, bool pooled)
+{
+    BitArray a(64 * static_cast<size_t>(state.range(0)));
+    auto src = random_words(a.word_count(), 1);
+    std::copy(src.begin(), src.end(), a.data());
+    const ParallelPolicy policy{std::max(2u, std::thread::hardware_concurrency()), 1};
+    for (auto _ : state)
+        benchmark::DoNotOptimize(pooled ? a.count(policy) : a.count());
+    state.SetBytesProcessed(state.iterations() * src.size() * sizeof(unsigned long));
+}
+
+
+static constexpr int64_t min_bits = 64;
+static constexpr int64_t max_bits = int64_t(1) << 30;
+
+
+// Registers every benchmark for one container as "<Benchmark>/<name>/<bits>";
+// sizes go from 64 bits to 1G bits in steps of 64x, or the one size of a
+// std::bitset
+template <typename Ops>
+static void register_container(const std::string& name, int64_t fixed_bits = 0)
+{
+    auto add = [&](const char* benchmark, void (*fn)(benchmark::State&)) {
+        auto* b = benchmark::RegisterBenchmark((std::string(benchmark) + "/" + name).c_str(), fn);
+        if (fixed_bits != 0)
+            b->Arg(fixed_bits);
+        else
+            b->RangeMultiplier(64)->Range(min_bits, max_bits);
+        b->Unit(benchmark::kMicrosecond);
+    };
+    add("Construct", BM_Construct<Ops>);
+    if constexpr (Ops::growable) {
+        add("PushBack", BM_PushBack<Ops>);
+        add("Resize", BM_Resize<Ops>);
+    }
+    add("Shift", BM_Shift<Ops>);
+    add("And", BM_And<Ops>);
+    add("Xor", BM_Xor<Ops>);
+    add("Flip", BM_Flip<Ops>);
+    add("Count", BM_Count<Ops>);
+    add("IterateSetBits", BM_IterateSetBits<Ops>);
+    add("ToString", BM_ToString<Ops>);
+}
+
+
+template <size_t... Sizes>
+static void register_bitsets(std::index_sequence<Sizes...>)
+{
+    (register_container<BitsetOps<Sizes>>("bitset", Sizes), ...);
+}
+
+int main(int argc, char** argv)
+{
+    for (const BitKernels* kernels : available_kernels()) {
+        std::string suffix = std::string("/") + kernels->name;
+        benchmark::RegisterBenchmark(("KernelPopcount" + suffix).c_str(), BM_KernelPopcount, kernels)
+            ->RangeMultiplier(16)->Range(16, 1 << 20);
+        benchmark::RegisterBenchmark(("KernelAnd" + suffix).c_str(), BM_KernelAnd, kernels)
+            ->RangeMultiplier(16)->Range(16, 1 << 20);
+        benchmark::RegisterBenchmark(("KernelXor" + suffix).c_str(), BM_KernelXor, kernels)
+            ->RangeMultiplier(16)->Range(16, 1 << 20);
+        benchmark::RegisterBenchmark(("KernelNot" + suffix).c_str(), BM_KernelNot, kernels)
+            ->RangeMultiplier(16)->Range(16, 1 << 20);
+        benchmark::RegisterBenchmark(("KernelTranspose" + suffix).c_str(), BM_KernelTranspose, kernels);
+    }
+
+    for (bool pooled : {false, true})
+        benchmark::RegisterBenchmark(pooled ? "ParallelCount/pooled" : "ParallelCount/serial", BM_ParallelCount, pooled)
+            ->RangeMultiplier(4)->Range(1 << 10, 1 << 22)->Unit(benchmark::kMicrosecond);
+
+    register_container<BitArrayOps>("BitArray");
+    register_bitsets(std::index_sequence<64, 4096, 262144, 16777216, 1073741824>{});
+    register_container<VectorBoolOps>("vector<bool>");
+#ifdef BITARRAY_BENCH_BOOST
+    register_container<DynamicBitsetOps>("dynamic_bitset");
+#endif
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,321 @@
+#include "bitarray_kernels.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define BITARRAY_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+
+// Scalar reference kernels
+
+static void scalar_and(unsigned long* dst, const unsigned long* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] &= src[i];
+}
+
+
+static void scalar_or(unsigned long* dst, const unsigned long* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] |= src[i];
+}
+
+
+static void scalar_xor(unsigned long* dst, const unsigned long* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] ^= src[i];
+}
+
+
+static void scalar_not(unsigned long* dst, const unsigned long* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = ~src[i];
+}
+
+
+static size_t scalar_popcount(const unsigned long* src, size_t n)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i)
+        total += __builtin_popcountl(src[i]);
+    return total;
+}
+
+
+// Swaps ever smaller off-diagonal blocks: 32x32, then 16x16, ... Each round
+// is the same masked swap over independent word pairs
+static void scalar_transpose_tile(unsigned long* tile)
+{
+    unsigned long mask = 0x00000000ffffffffUL;
+    for (unsigned width = 32; width != 0; width >>= 1, mask ^= mask << width) {
+        for (unsigned k = 0; k < 64; k = (k + width + 1) & ~width) {
+            unsigned long t = ((tile[k] >> width) ^ tile[k + width]) & mask;
+            tile[k] ^= t << width;
+            tile[k + width] ^= t;
+        }
+    }
+}
+
+
+#ifdef BITARRAY_X86_KERNELS
+
+// SSE2 tile transpose, 2 word pairs per vector. SSE2 is part of x86-64, so
+// it needs no CPUID check and serves every wider set.
+static void sse2_transpose_tile(unsigned long* tile)
+{
+    auto load = [&](unsigned k) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile + k)); };
+    auto store = [&](unsigned k, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(tile + k), v); };
+
+    unsigned long mask = 0x00000000ffffffffUL;
+    unsigned width = 32;
+    for (; width != 1; width >>= 1, mask ^= mask << width) {
+        const __m128i m = _mm_set1_epi64x(static_cast<long long>(mask));
+        const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(width));
+        for (unsigned k = 0; k < 64; k = (k + width + 2) & ~width) {
+            const __m128i a = load(k), b = load(k + width);
+            const __m128i t = _mm_and_si128(_mm_xor_si128(_mm_srl_epi64(a, shift), b), m);
+            store(k, _mm_xor_si128(a, _mm_sll_epi64(t, shift)));
+            store(k + width, _mm_xor_si128(b, t));
+        }
+    }
+
+    // Width 1 pairs neighbouring words, so regroup even and odd words first
+    const __m128i m = _mm_set1_epi64x(static_cast<long long>(mask));
+    for (unsigned k = 0; k < 64; k += 4) {
+        const __m128i x = load(k), y = load(k + 2);
+        __m128i a = _mm_unpacklo_epi64(x, y), b = _mm_unpackhi_epi64(x, y);
+        const __m128i t = _mm_and_si128(_mm_xor_si128(_mm_srli_epi64(a, 1), b), m);
+        a = _mm_xor_si128(a, _mm_slli_epi64(t, 1));
+        b = _mm_xor_si128(b, t);
+        store(k, _mm_unpacklo_epi64(a, b));
+        store(k + 2, _mm_unpackhi_epi64(a, b));
+    }
+}
+
+
+// AVX2 kernels, 4 words per vector
+
+#define AVX2_BINARY_KERNEL(name, intrinsic, op)                                   \
+    __attribute__((target("avx2")))                                             \
+    static void name(unsigned long* dst, const unsigned long* src, size_t n)    \
+    {                                                                           \
+        size_t i = 0;                                                           \
+        for (; i + 4 <= n; i += 4) {                                            \
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i)); \
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)); \
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), intrinsic(a, b)); \
+        }                                                                       \
+        for (; i < n; ++i)                                                      \
+            dst[i] op src[i];                                                   \
+    }
+
+AVX2_BINARY_KERNEL(avx2_and, _mm256_and_si256, &=)
+AVX2_BINARY_KERNEL(avx2_or, _mm256_or_si256, |=)
+AVX2_BINARY_KERNEL(avx2_xor, _mm256_xor_si256, ^=)
+
+#undef AVX2_BINARY_KERNEL
+
+
+__attribute__((target("avx2")))
+static void avx2_not(unsigned long* dst, const unsigned long* src, size_t n)
+{
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(a, ones));
+    }
+    for (; i < n; ++i)
+        dst[i] = ~src[i];
+}
+
+
+// Per-64-bit-lane popcount of a vector via the nibble lookup table (Mula)
+__attribute__((target("avx2")))
+static inline __m256i avx2_popcount_lanes(__m256i v)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_load(const unsigned long* src, size_t vector_index)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 4 * vector_index));
+}
+
+
+// Carry-save adder: (high, low) = a + b + c bitwise
+__attribute__((target("avx2")))
+static inline void avx2_csa(__m256i& high, __m256i& low, __m256i a, __m256i b, __m256i c)
+{
+    __m256i u = _mm256_xor_si256(a, b);
+    high = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+    low = _mm256_xor_si256(u, c);
+}
+
+
+// Harley-Seal popcount: a tree of carry-save adders folds 16 vectors into
+// one, so the expensive lookup runs once per 16 vectors instead of each one
+__attribute__((target("avx2")))
+static size_t avx2_popcount(const unsigned long* src, size_t n)
+{
+    const size_t vectors = n / 4;
+    __m256i total = _mm256_setzero_si256();
+    __m256i ones = _mm256_setzero_si256();
+    __m256i twos = _mm256_setzero_si256();
+    __m256i fours = _mm256_setzero_si256();
+    __m256i eights = _mm256_setzero_si256();
+    __m256i sixteens, twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+
+    size_t v = 0;
+    for (; v + 16 <= vectors; v += 16) {
+        avx2_csa(twos_a, ones, ones, avx2_load(src, v), avx2_load(src, v + 1));
+        avx2_csa(twos_b, ones, ones, avx2_load(src, v + 2), avx2_load(src, v + 3));
+        avx2_csa(fours_a, twos, twos, twos_a, twos_b);
+        avx2_csa(twos_a, ones, ones, avx2_load(src, v + 4), avx2_load(src, v + 5));
+        avx2_csa(twos_b, ones, ones, avx2_load(src, v + 6), avx2_load(src, v + 7));
+        avx2_csa(fours_b, twos, twos, twos_a, twos_b);
+        avx2_csa(eights_a, fours, fours, fours_a, fours_b);
+        avx2_csa(twos_a, ones, ones, avx2_load(src, v + 8), avx2_load(src, v + 9));
+        avx2_csa(twos_b, ones, ones, avx2_load(src, v + 10), avx2_load(src, v + 11));
+        avx2_csa(fours_a, twos, twos, twos_a, twos_b);
+        avx2_csa(twos_a, ones, ones, avx2_load(src, v + 12), avx2_load(src, v + 13));
+        avx2_csa(twos_b, ones, ones, avx2_load(src, v + 14), avx2_load(src, v + 15));
+        avx2_csa(fours_b, twos, twos, twos_a, twos_b);
+        avx2_csa(eights_b, fours, fours, fours_a, fours_b);
+        avx2_csa(sixteens, eights, eights, eights_a, eights_b);
+        total = _mm256_add_epi64(total, avx2_popcount_lanes(sixteens));
+    }
+
+    total = _mm256_slli_epi64(total, 4);
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(avx2_popcount_lanes(eights), 3));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(avx2_popcount_lanes(fours), 2));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(avx2_popcount_lanes(twos), 1));
+    total = _mm256_add_epi64(total, avx2_popcount_lanes(ones));
+    for (; v < vectors; ++v)
+        total = _mm256_add_epi64(total, avx2_popcount_lanes(avx2_load(src, v)));
+
+    size_t result = static_cast<size_t>(_mm256_extract_epi64(total, 0)) +
+                    static_cast<size_t>(_mm256_extract_epi64(total, 1)) +
+                    static_cast<size_t>(_mm256_extract_epi64(total, 2)) +
+                    static_cast<size_t>(_mm256_extract_epi64(total, 3));
+    for (size_t i = 4 * vectors; i < n; ++i)
+        result += __builtin_popcountl(src[i]);
+    return result;
+}
+
+
+// AVX-512 kernels, 8 words per vector, tails handled with masked loads
+
+#define AVX512_BINARY_KERNEL(name, intrinsic)                                     \
+    __attribute__((target("avx512f")))                                          \
+    static void name(unsigned long* dst, const unsigned long* src, size_t n)    \
+    {                                                                           \
+        size_t i = 0;                                                           \
+        for (; i + 8 <= n; i += 8) {                                            \
+            __m512i a = _mm512_loadu_si512(dst + i);                            \
+            __m512i b = _mm512_loadu_si512(src + i);                            \
+            _mm512_storeu_si512(dst + i, intrinsic(a, b));                      \
+        }                                                                       \
+        if (i < n) {                                                            \
+            __mmask8 mask = static_cast<__mmask8>((1u << (n - i)) - 1);         \
+            __m512i a = _mm512_maskz_loadu_epi64(mask, dst + i);                \
+            __m512i b = _mm512_maskz_loadu_epi64(mask, src + i);                \
+            _mm512_mask_storeu_epi64(dst + i, mask, intrinsic(a, b));           \
+        }                                                                       \
+    }
+
+AVX512_BINARY_KERNEL(avx512_and, _mm512_and_si512)
+AVX512_BINARY_KERNEL(avx512_or, _mm512_or_si512)
+AVX512_BINARY_KERNEL(avx512_xor, _mm512_xor_si512)
+
+#undef AVX512_BINARY_KERNEL
+
+
+__attribute__((target("avx512f")))
+static void avx512_not(unsigned long* dst, const unsigned long* src, size_t n)
+{
+    const __m512i ones = _mm512_set1_epi64(-1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm512_storeu_si512(dst + i, _mm512_xor_si512(_mm512_loadu_si512(src + i), ones));
+    if (i < n) {
+        __mmask8 mask = static_cast<__mmask8>((1u << (n - i)) - 1);
+        __m512i a = _mm512_maskz_loadu_epi64(mask, src + i);
+        _mm512_mask_storeu_epi64(dst + i, mask, _mm512_xor_si512(a, ones));
+    }
+}
+
+
+// VPOPCNTDQ counts each 64-bit lane directly, no adder tree needed
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static size_t avx512_popcount(const unsigned long* src, size_t n)
+{
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512(src + i)));
+    if (i < n) {
+        __mmask8 mask = static_cast<__mmask8>((1u << (n - i)) - 1);
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(mask, src + i)));
+    }
+    // Summed through memory: GCC 12's _mm512_reduce_add_epi64 (and the 256-bit
+    // extracts it is built on) trip -Wuninitialized inside the header
+    alignas(64) unsigned long lanes[8];
+    _mm512_store_si512(lanes, total);
+    size_t result = 0;
+    for (unsigned long lane : lanes)
+        result += lane;
+    return result;
+}
+
+#endif // BITARRAY_X86_KERNELS
+
+
+const BitKernels& scalar_kernels()
+{
+    static const BitKernels kernels{"scalar", scalar_and, scalar_or, scalar_xor, scalar_not, scalar_popcount,
+                                    scalar_transpose_tile};
+    return kernels;
+}
+
+
+std::vector<const BitKernels*> available_kernels()
+{
+    std::vector<const BitKernels*> result{&scalar_kernels()};
+#ifdef BITARRAY_X86_KERNELS
+    // __builtin_cpu_supports reads CPUID and also checks that the OS saves the wide registers
+    static const BitKernels avx2{"avx2", avx2_and, avx2_or, avx2_xor, avx2_not, avx2_popcount, sse2_transpose_tile};
+    // The bitwise kernels need only AVX-512F; without VPOPCNTDQ the count stays on AVX2
+    static const BitKernels avx512f{"avx512f", avx512_and, avx512_or, avx512_xor, avx512_not, avx2_popcount,
+                                    sse2_transpose_tile};
+    static const BitKernels avx512{"avx512", avx512_and, avx512_or, avx512_xor, avx512_not, avx512_popcount,
+                                   sse2_transpose_tile};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        result.push_back(&avx2);
+    if (__builtin_cpu_supports("avx512f"))
+        result.push_back(&avx512f);
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq"))
+        result.push_back(&avx512);
+#endif
+    return result;
+}
+
+
+const BitKernels& active_kernels()
+{
+    // The widest supported set, chosen once
+    static const BitKernels& kernels = *available_kernels().back();
+    return kernels;
+}
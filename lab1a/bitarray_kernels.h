@@ -0,0 +1,38 @@
+#ifndef BITARRAY_KERNELS_H
+#define BITARRAY_KERNELS_H
+
+#include <cstddef>
+#include <vector>
+
+// Word-level kernels behind BitArray's bulk operations.
+// Every set computes exactly the same results as scalar_kernels(); the wider
+// ones are only used when CPUID reports the instructions they need.
+struct BitKernels {
+    const char* name;
+
+    // dst[i] = dst[i] op src[i] for i in [0, n)
+    void (*and_words)(unsigned long* dst, const unsigned long* src, size_t n);
+    void (*or_words)(unsigned long* dst, const unsigned long* src, size_t n);
+    void (*xor_words)(unsigned long* dst, const unsigned long* src, size_t n);
+
+    // dst[i] = ~src[i] for i in [0, n), dst may alias src
+    void (*not_words)(unsigned long* dst, const unsigned long* src, size_t n);
+
+    // Number of set bits in src[0, n)
+    size_t (*popcount)(const unsigned long* src, size_t n);
+
+    // Transposes the 64x64 bit tile in tile[0, 64) in place: bit j of word i
+    // swaps with bit i of word j
+    void (*transpose_tile)(unsigned long* tile);
+};
+
+// Plain word loops, the reference implementation
+const BitKernels& scalar_kernels();
+
+// Kernel set picked once (on first use) for the running CPU
+const BitKernels& active_kernels();
+
+// Every kernel set the running CPU can execute, scalar first
+std::vector<const BitKernels*> available_kernels();
+
+#endif // BITARRAY_KERNELS_H
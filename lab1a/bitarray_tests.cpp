@@ -1,6 +1,27 @@
 #include "bitarray.h"
+#include "bitarray_kernels.h"
+#include "rank_select.h"
+#include "roaring_bitmap.h"
+#include "atomic_bitarray.h"
+#include "mapped_bitarray.h"
+#include "fixed_bitarray.h"
+#include "bloom_filter.h"
+#include "bit_matrix.h"
+#include "packed_int_array.h"
+#include "cow_bitarray.h"
+#include "ewah_bitmap.h"
 #include "gtest/gtest.h"
 #include <stdexcept>
+#include <random>
+#include <vector>
+#include <thread>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <set>
+#include <unordered_set>
+#include <type_traits>
+#include <utility>
 
 
 TEST(BitArrayTest, DefaultConstructor) 
@@ -24,7 +45,7 @@ TEST(BitArrayTest, CopyConstructor)
     BitArray ba(64, 1);
     BitArray ba_copy(ba);
     ASSERT_EQ(ba_copy.size(), ba.size());
-    for (int i = 0; i < ba_copy.size(); ++i) 
+    for (size_t i = 0; i < ba_copy.size(); ++i) 
     {
         ASSERT_EQ(ba_copy[i], ba[i]);  
     }
@@ -37,7 +58,7 @@ TEST(BitArrayTest, AssignmentOperator)
     BitArray ba2;
     ba2 = ba1;
     ASSERT_EQ(ba2.size(), ba1.size());
-    for (int i = 0; i < ba2.size(); ++i) 
+    for (size_t i = 0; i < ba2.size(); ++i) 
         ASSERT_EQ(ba2[i], ba1[i]); 
 }
 
@@ -346,3 +367,1635 @@ TEST(BitArrayTest, IteratorEqualityInequality)
     ++it3;  
     ASSERT_EQ(it1, it3); 
 }
+
+
+TEST(BitArrayTest, ShiftAcrossWords) 
+{
+    BitArray ba(200);
+    ba.set(0);
+    ba.set(70);
+    ba <<= 63;
+    ASSERT_EQ(ba.count(), 2);
+    ASSERT_TRUE(ba[63]);
+    ASSERT_TRUE(ba[133]);
+
+    ba >>= 63;
+    ASSERT_EQ(ba.count(), 2);
+    ASSERT_TRUE(ba[0]);
+    ASSERT_TRUE(ba[70]);
+
+    ba <<= 130;
+    ASSERT_EQ(ba.count(), 1);
+    ASSERT_TRUE(ba[130]);
+}
+
+
+TEST(BitArrayTest, ShiftDropsBitsPastSize) 
+{
+    BitArray ba(70);
+    ba.set(69);
+    ba <<= 1;
+    ASSERT_EQ(ba.count(), 0);
+    ba.resize(71);
+    ASSERT_FALSE(ba[70]);
+    ASSERT_THROW(ba <<= -1, std::invalid_argument);
+}
+
+
+TEST(BitArrayTest, Rotate) 
+{
+    BitArray ba(100);
+    ba.set(0);
+    ba.set(99);
+    ba.rotate_left(1);
+    ASSERT_EQ(ba.count(), 2);
+    ASSERT_TRUE(ba[0]);
+    ASSERT_TRUE(ba[1]);
+
+    ba.rotate_right(2);
+    ASSERT_TRUE(ba[98]);
+    ASSERT_TRUE(ba[99]);
+
+    ba.rotate_left(300);
+    ASSERT_TRUE(ba[98]);
+    ASSERT_TRUE(ba[99]);
+    ASSERT_EQ(ba.count(), 2);
+
+    // Against shifts, from both sides and across word boundaries
+    std::mt19937_64 rng(26);
+    for (size_t size : {1, 63, 64, 65, 130, 1000}) {
+        BitArray r(size);
+        for (size_t i = 0; i < size; ++i)
+            r.set(i, rng() & 1);
+        for (size_t k : {size_t(1), size_t(37), size_t(64), size / 2, size - 1, size + 5}) {
+            const size_t m = k % size;
+            const BitArray expected = m == 0 ? r : (r << m) | (r >> (size - m));
+            ASSERT_EQ(BitArray(r).rotate_left(k), expected);
+            ASSERT_EQ(BitArray(r).rotate_right(size - m), expected);
+        }
+    }
+}
+
+
+TEST(BitArrayTest, ResizeFillsNewBitsOnly) 
+{
+    BitArray ba(10, 0b101);
+    ba.resize(100, true);
+    ASSERT_EQ(ba.count(), 92);
+    ASSERT_FALSE(ba[1]);
+    ASSERT_TRUE(ba[99]);
+
+    ba.resize(3);
+    ASSERT_EQ(ba.to_string(), "101");
+    ba.resize(70);
+    ASSERT_EQ(ba.count(), 2);
+}
+
+
+TEST(BitArrayTest, PushBackManyBits) 
+{
+    BitArray ba;
+    for (int i = 0; i < 1000; ++i)
+        ba.push_back(i % 3 == 0);
+    ASSERT_EQ(ba.size(), 1000);
+    ASSERT_EQ(ba.count(), 334);
+    ASSERT_TRUE(ba[999]);
+    ASSERT_FALSE(ba[998]);
+    ASSERT_GE(ba.capacity(), 1000);
+}
+
+
+TEST(BitArrayTest, ReserveAndShrink) 
+{
+    BitArray ba;
+    ba.reserve(1000);
+    ASSERT_GE(ba.capacity(), 1000);
+    ASSERT_EQ(ba.size(), 0);
+
+    ba.push_back(true);
+    ba.shrink_to_fit();
+    ASSERT_EQ(ba.capacity(), 128);
+    ASSERT_TRUE(ba[0]);
+    ASSERT_THROW(ba.reserve(-1), std::invalid_argument);
+}
+
+
+TEST(BitArrayTest, SmallArraysStayInline) 
+{
+    BitArray ba(100, 7);
+    ASSERT_EQ(ba.capacity(), 128);
+    BitArray copy(ba);
+    ASSERT_EQ(copy.capacity(), 128);
+    ASSERT_EQ(copy, ba);
+
+    ba.resize(129);
+    ASSERT_GE(ba.capacity(), 129);
+    ASSERT_EQ(ba.count(), 3);
+    ba.resize(100);
+    ba.shrink_to_fit();
+    ASSERT_EQ(ba.capacity(), 128);
+    ASSERT_EQ(ba, copy);
+}
+
+
+TEST(BitArrayTest, SwapInlineWithHeap) 
+{
+    BitArray small(10, 3);
+    BitArray large(1000);
+    large.set(999);
+
+    small.swap(large);
+    ASSERT_EQ(small.size(), 1000);
+    ASSERT_TRUE(small[999]);
+    ASSERT_EQ(large.size(), 10);
+    ASSERT_EQ(large.count(), 2);
+
+    large = small;
+    ASSERT_EQ(large, small);
+    small = BitArray(5, 1);
+    ASSERT_EQ(small.to_string(), "00001");
+}
+
+
+TEST(BitArrayTest, SizesAbove32Bits)
+{
+    // 2^32 + 100 bits, about 512MB
+    const size_t n = (size_t(1) << 32) + 100;
+    BitArray ba(n);
+    ASSERT_EQ(ba.size(), n);
+    ba.set(size_t(1) << 31);
+    ba.set((size_t(1) << 32) + 1);
+    ba.set(n - 1);
+    ASSERT_TRUE(ba[(size_t(1) << 32) + 1]);
+    ASSERT_FALSE(ba[size_t(1) << 32]);
+    ASSERT_EQ(ba.count(), 3);
+    ASSERT_EQ(ba.find_first(), size_t(1) << 31);
+    ASSERT_EQ(ba.find_next(size_t(1) << 31), (size_t(1) << 32) + 1);
+    ASSERT_EQ(ba.find_last(), n - 1);
+    ASSERT_THROW(ba[n], std::out_of_range);
+    ASSERT_THROW(RoaringBitmap{ba}, std::invalid_argument);  // Chunk keys are 16 bits
+
+    ba >>= size_t(1) << 32;
+    ASSERT_EQ(ba.count(), 2);
+    ASSERT_TRUE(ba[1]);
+    ASSERT_TRUE(ba[99]);
+    ba <<= (size_t(1) << 32) - 1;
+    ASSERT_EQ(ba.find_first(), (size_t(1) << 32));
+    ASSERT_EQ(ba.count(), 2);
+}
+
+
+TEST(BitArrayTest, NegativeIntArgumentsStillThrow)
+{
+    // Negative ints wrap past max_size() and are rejected like before
+    BitArray ba(10);
+    ASSERT_THROW(BitArray(-1), std::invalid_argument);
+    ASSERT_THROW(ba.resize(-5), std::invalid_argument);
+    ASSERT_THROW(ba.set(-1), std::out_of_range);
+    ASSERT_THROW(ba >>= -3, std::invalid_argument);
+    ASSERT_EQ(ba.find_first(), BitArray::npos);
+    int first = ba.find_first();
+    ASSERT_EQ(first, -1);
+}
+
+
+TEST(BitArrayTest, StringHexAndBytesRoundTrip)
+{
+    std::mt19937_64 rng(11);
+    for (size_t n : {0, 1, 7, 8, 9, 63, 64, 65, 130, 1000}) {
+        BitArray ba(n);
+        std::string naive;
+        for (size_t i = n; i-- > 0;) {
+            bool bit = rng() % 2;
+            ba.set(i, bit);
+            naive += bit ? '1' : '0';
+        }
+
+        ASSERT_EQ(ba.to_string(), naive);
+        ASSERT_EQ(BitArray::from_string(naive), ba);
+        ASSERT_EQ(ba.to_hex().size(), ba.hex_size());
+        ASSERT_EQ(BitArray::from_hex(ba.to_hex(), n), ba);
+        ASSERT_EQ(BitArray::from_bytes(ba.to_bytes(), n), ba);
+    }
+}
+
+
+TEST(BitArrayTest, HexAndBytesLayout)
+{
+    BitArray ba(12, 0xabc);
+    ASSERT_EQ(ba.to_hex(), "abc");
+    ASSERT_EQ(BitArray::from_hex("ABC"), ba);
+    ASSERT_EQ(BitArray(10, 0x2f5).to_hex(), "2f5");
+    ASSERT_EQ(ba.to_bytes(), (std::vector<std::uint8_t>{0xbc, 0x0a}));
+
+    // The buffers are only written up to the converted length
+    std::string text(16, '.');
+    ba.write_string(text);
+    ASSERT_EQ(text, "101010111100....");
+    std::uint8_t raw[1];
+    ASSERT_THROW(ba.write_bytes(raw), std::length_error);
+    char digits[2];
+    ASSERT_THROW(ba.write_hex(digits), std::length_error);
+
+    ASSERT_THROW(BitArray::from_string("0101201"), std::invalid_argument);
+    ASSERT_THROW(BitArray::from_string("01010101/1010101"), std::invalid_argument);
+    ASSERT_THROW(BitArray::from_hex("12g"), std::invalid_argument);
+    ASSERT_THROW(BitArray::from_hex("abc", 13), std::invalid_argument);
+    ASSERT_THROW(BitArray::from_hex("abc", 10), std::invalid_argument);
+    ASSERT_THROW(BitArray::from_bytes(raw, 9), std::invalid_argument);
+}
+
+
+TEST(BitArrayTest, RangeOperationsMatchPerBit)
+{
+    std::mt19937_64 rng(5);
+    const size_t n = 1000;
+    BitArray ba(n);
+    std::vector<bool> naive(n);
+    for (int round = 0; round < 200; ++round) {
+        size_t first = rng() % (n + 1);
+        size_t last = rng() % (n + 1);
+        if (first > last)
+            std::swap(first, last);
+
+        size_t expected = 0;
+        for (size_t i = first; i < last; ++i)
+            expected += naive[i];
+        ASSERT_EQ(ba.count_range(first, last), expected);
+
+        switch (round % 3) {
+        case 0:
+            ba.set_range(first, last);
+            for (size_t i = first; i < last; ++i) naive[i] = true;
+            break;
+        case 1:
+            ba.reset_range(first, last);
+            for (size_t i = first; i < last; ++i) naive[i] = false;
+            break;
+        default:
+            ba.flip_range(first, last);
+            for (size_t i = first; i < last; ++i) naive[i] = !naive[i];
+        }
+        for (size_t i = 0; i < n; ++i)
+            ASSERT_EQ(ba[i], naive[i]);
+    }
+
+    ASSERT_EQ(ba.count_range(0, n), ba.count());
+    ASSERT_THROW(ba.set_range(10, 1001), std::out_of_range);
+    ASSERT_THROW(ba.flip_range(20, 10), std::out_of_range);
+    ASSERT_THROW(ba.count_range(0, n + 1), std::out_of_range);
+}
+
+
+TEST(BitArrayTest, BatchedIndexAccess)
+{
+    std::mt19937_64 rng(9);
+    const size_t n = 100000;
+    std::vector<std::uint64_t> marks(3000), probes(5000);
+    for (std::uint64_t& i : marks) i = rng() % n;
+    for (std::uint64_t& i : probes) i = rng() % n;
+
+    BitArray ba(n), naive(n);
+    ba.set_many(marks);
+    for (std::uint64_t i : marks)
+        naive.set(i);
+    ASSERT_EQ(ba, naive);
+
+    BitArray hits;
+    ba.test_many(probes, hits);
+    std::vector<std::uint8_t> bytes(probes.size());
+    ba.test_many(probes, bytes);
+    size_t expected = 0;
+    ASSERT_EQ(hits.size(), probes.size());
+    for (size_t j = 0; j < probes.size(); ++j) {
+        ASSERT_EQ(hits[j], naive[probes[j]]);
+        ASSERT_EQ(bytes[j], naive[probes[j]]);
+        expected += naive[probes[j]];
+    }
+    ASSERT_EQ(ba.count_hits(probes), expected);
+
+    ba.set_many(marks, false);
+    ASSERT_TRUE(ba.none());
+
+    // One bad index rejects the whole batch before anything is written
+    std::vector<std::uint64_t> bad = {1, 2, n};
+    ASSERT_THROW(ba.set_many(bad), std::out_of_range);
+    ASSERT_TRUE(ba.none());
+    ASSERT_THROW(ba.count_hits(bad), std::out_of_range);
+    ASSERT_THROW(ba.test_many(probes, std::span<std::uint8_t>(bytes.data(), 10)), std::length_error);
+}
+
+
+TEST(BitArrayTest, UnusedBitsStayZero)
+{
+    // Values and fills never leave bits past size() set
+    ASSERT_EQ(BitArray(3, 0xff), BitArray(3, 7));
+    ASSERT_EQ(BitArray(3, 0xff).hash(), BitArray(3, 7).hash());
+
+    BitArray a(70);
+    a.set();
+    ASSERT_EQ(a.word(1), 0x3fUL);
+    a.resize(75);
+    ASSERT_EQ(a.count(), 70);
+    a.resize(66);
+    a.resize(70);
+    ASSERT_EQ(a.count(), 66);
+
+    BitArray b(70);
+    b.set();
+    b >>= 4;
+    ASSERT_EQ(b.count(), 66);
+    ASSERT_EQ(b.find_last(), 65);
+    ASSERT_EQ(~~b, b);
+}
+
+
+TEST(BitArrayTest, HashAndOrdering)
+{
+    std::mt19937_64 rng(47);
+    std::vector<BitArray> arrays;
+    for (size_t n : {0, 1, 63, 64, 65, 128, 200}) {
+        for (int k = 0; k < 4; ++k) {
+            BitArray ba(n);
+            for (size_t i = 0; i < n; ++i)
+                ba.set(i, rng() & 1);
+            arrays.push_back(ba);
+        }
+    }
+
+    std::unordered_set<BitArray> hashed(arrays.begin(), arrays.end());
+    std::set<BitArray> ordered(arrays.begin(), arrays.end());
+    ASSERT_EQ(hashed.size(), ordered.size());
+    for (const BitArray& ba : arrays) {
+        ASSERT_EQ(hashed.count(ba), 1);
+        ASSERT_EQ(std::hash<BitArray>{}(ba), ba.hash());
+    }
+
+    // Same order as std::vector<bool>
+    auto bools = [](const BitArray& ba) {
+        std::vector<bool> v(ba.size());
+        for (size_t i = 0; i < ba.size(); ++i)
+            v[i] = ba[i];
+        return v;
+    };
+    for (const BitArray& x : arrays) {
+        for (const BitArray& y : arrays) {
+            ASSERT_EQ(x <=> y, bools(x) <=> bools(y));
+            ASSERT_EQ(x == y, (x <=> y) == 0);
+        }
+    }
+
+    // A prefix orders first, the lowest differing bit decides, size is hashed
+    ASSERT_LT(BitArray(64, 5), BitArray(65, 5));
+    ASSERT_LT(BitArray(8, 0x80), BitArray(8, 0x01));
+    ASSERT_NE(BitArray(64).hash(), BitArray(65).hash());
+}
+
+TEST(BitKernelsTest, MatchScalarReference) 
+{
+    std::mt19937_64 rng(42);
+    const BitKernels& reference = scalar_kernels();
+    for (size_t n : {0, 1, 3, 4, 7, 9, 63, 64, 65, 300}) 
+    {
+        std::vector<unsigned long> a(n), b(n);
+        for (size_t i = 0; i < n; ++i) 
+        {
+            a[i] = rng();
+            b[i] = rng();
+        }
+
+        for (const BitKernels* kernels : available_kernels()) 
+        {
+            SCOPED_TRACE(kernels->name);
+            ASSERT_EQ(kernels->popcount(a.data(), n), reference.popcount(a.data(), n));
+
+            std::vector<unsigned long> expected = a, actual = a;
+            reference.xor_words(expected.data(), b.data(), n);
+            kernels->xor_words(actual.data(), b.data(), n);
+            ASSERT_EQ(actual, expected);
+            reference.and_words(expected.data(), b.data(), n);
+            kernels->and_words(actual.data(), b.data(), n);
+            ASSERT_EQ(actual, expected);
+            reference.or_words(expected.data(), a.data(), n);
+            kernels->or_words(actual.data(), a.data(), n);
+            ASSERT_EQ(actual, expected);
+            reference.not_words(expected.data(), expected.data(), n);
+            kernels->not_words(actual.data(), actual.data(), n);
+            ASSERT_EQ(actual, expected);
+        }
+    }
+
+    // Tile transpose: bit j of word i lands on bit i of word j
+    std::vector<unsigned long> tile(64);
+    for (unsigned long& word : tile)
+        word = rng();
+    for (const BitKernels* kernels : available_kernels())
+    {
+        SCOPED_TRACE(kernels->name);
+        std::vector<unsigned long> transposed = tile;
+        kernels->transpose_tile(transposed.data());
+        for (size_t i = 0; i < 64; ++i)
+            for (size_t j = 0; j < 64; ++j)
+                ASSERT_EQ((transposed[j] >> i) & 1, (tile[i] >> j) & 1);
+    }
+}
+
+
+TEST(BitArrayTest, CountLargeArray) 
+{
+    BitArray ba(5000);
+    for (int i = 0; i < 5000; i += 7)
+        ba.set(i);
+    ASSERT_EQ(ba.count(), 715);
+    ASSERT_EQ((ba ^ ba).count(), 0);
+    ASSERT_EQ(count(ba | ~ba), 5000);
+}
+
+
+TEST(BitExpressionTest, FusedAssignment) 
+{
+    BitArray a(130), b(130), c(130);
+    a.set(0).set(1).set(129);
+    b.set(1).set(129);
+    c.set(1).set(64);
+
+    BitArray result = (a & b) | ~c;
+    ASSERT_EQ(result.size(), 130);
+    ASSERT_EQ(result.count(), 129);
+    ASSERT_TRUE(result[1]);
+    ASSERT_FALSE(result[64]);
+
+    result = a ^ b;
+    ASSERT_EQ(result.count(), 1);
+    ASSERT_TRUE(result[0]);
+}
+
+
+TEST(BitExpressionTest, FusedReductions) 
+{
+    BitArray a(100), b(100);
+    a.set(3).set(50).set(99);
+    b.set(50).set(99).set(10);
+
+    ASSERT_EQ(count(a & b), 2);
+    ASSERT_EQ(count(a | b), 4);
+    ASSERT_EQ(count(a ^ b), 2);
+    ASSERT_EQ(count(~a), 97);
+    ASSERT_TRUE(any(a & ~b));
+    ASSERT_FALSE(any(a & ~a));
+}
+
+
+TEST(BitExpressionTest, NodeAccessAndLookup)
+{
+    BitArray a(100), b(100);
+    a.set(3).set(50).set(99);
+    b.set(50).set(99).set(10);
+
+    // Nodes answer single bits and strings without a named result
+    ASSERT_TRUE((a & b)[50]);
+    ASSERT_FALSE((a & b)[3]);
+    ASSERT_TRUE((~a)[0]);
+    ASSERT_THROW((void)(a & b)[100], std::out_of_range);
+    ASSERT_EQ((a ^ b).to_string(), (BitArray(a) ^= b).to_string());
+    ASSERT_EQ((a | b).eval(), BitArray(a) |= b);
+
+    // auto keeps the node, which reads its operands again on every use
+    auto view = a & b;
+    const BitArray value = a & b;
+    a.reset(50);
+    ASSERT_EQ(view.count(), 1);
+    ASSERT_EQ(value.count(), 2);
+
+    // The fused count is found by argument-dependent lookup next to std::count
+    using namespace std;
+    const std::vector<int> v{1, 2, 1};
+    ASSERT_EQ(count(v.begin(), v.end(), 1), 2);
+    ASSERT_EQ(count(a | b), 4);
+    ASSERT_TRUE((a & ~b).any());
+}
+
+
+TEST(BitExpressionTest, AliasingAndCompound) 
+{
+    BitArray a(70, 0b1100), b(70, 0b1010);
+    a = a ^ b;
+    ASSERT_EQ(a.to_string().substr(66), "0110");
+
+    a |= ~b;
+    ASSERT_EQ(a.count(), 69);
+    a &= b & ~b;
+    ASSERT_TRUE(a.none());
+    ASSERT_THROW(a & BitArray(71), std::invalid_argument);
+    ASSERT_THROW(a ^= ~BitArray(71), std::invalid_argument);
+}
+
+
+TEST(RankSelectTest, MatchesNaiveRankAndSelect) 
+{
+    std::mt19937_64 rng(7);
+    BitArray ba(300000);
+    for (size_t i = 0; i < ba.size(); ++i)
+        if (rng() % 5 == 0)
+            ba.set(i);
+
+    RankSelect index(ba);
+    ASSERT_EQ(index.ones(), ba.count());
+    ASSERT_LT(index.memory_usage() * 8, ba.size() / 25);  // Under 4% overhead
+
+    size_t ones = 0;
+    for (size_t i = 0; i < ba.size(); ++i) 
+    {
+        ASSERT_EQ(index.rank1(i), ones);
+        if (ba[i]) 
+        {
+            ASSERT_EQ(index.select1(ones), static_cast<size_t>(i));
+            ++ones;
+        }
+    }
+    ASSERT_EQ(index.rank1(ba.size()), ones);
+    ASSERT_EQ(index.rank0(ba.size()), ba.size() - ones);
+    ASSERT_THROW(index.select1(ones), std::out_of_range);
+}
+
+
+TEST(RankSelectTest, DenseAndEmpty) 
+{
+    BitArray ba(5000);
+    RankSelect index(ba);
+    ASSERT_EQ(index.rank1(5000), 0);
+    ASSERT_THROW(index.select1(0), std::out_of_range);
+
+    ba.set();
+    ASSERT_FALSE(index.is_valid());
+    index.rebuild();
+    ASSERT_EQ(index.rank1(4999), 4999);
+    ASSERT_EQ(index.select1(4999), 4999);
+    ASSERT_EQ(index.ones(), 5000);
+}
+
+
+TEST(RankSelectTest, StaleAfterMutation) 
+{
+    BitArray ba(100, 0b1011);
+    RankSelect index(ba);
+    ASSERT_EQ(index.rank1(4), 3);
+
+    ba.reset(0);
+    ASSERT_THROW(index.rank1(4), std::logic_error);
+    index.rebuild();
+    ASSERT_EQ(index.rank1(4), 2);
+    ASSERT_EQ(index.select1(1), 3);
+
+    BitArray other(100);
+    ba = other;
+    ASSERT_FALSE(index.is_valid());
+    index.rebuild();
+    ba = ba & other;
+    ASSERT_FALSE(index.is_valid());
+}
+
+
+TEST(BitArrayTest, FindFirstNextLast) 
+{
+    BitArray ba(300);
+    ASSERT_EQ(ba.find_first(), BitArray::npos);
+    ASSERT_EQ(ba.find_last(), BitArray::npos);
+
+    ba.set(5).set(64).set(299);
+    ASSERT_EQ(ba.find_first(), 5);
+    ASSERT_EQ(ba.find_next(5), 64);
+    ASSERT_EQ(ba.find_next(64), 299);
+    ASSERT_EQ(ba.find_next(299), BitArray::npos);
+    ASSERT_EQ(ba.find_last(), 299);
+    ASSERT_THROW(ba.find_next(300), std::out_of_range);
+
+    BitArray full(70);
+    full.set();  // Also sets the unused bits of the last word
+    ASSERT_EQ(full.find_last(), 69);
+    ASSERT_EQ(full.find_next(69), BitArray::npos);
+}
+
+
+TEST(BitArrayTest, SetBitsRange) 
+{
+    BitArray ba(1000);
+    std::vector<int> expected = {0, 63, 64, 500, 999};
+    for (int i : expected)
+        ba.set(i);
+
+    std::vector<int> visited;
+    for (int i : ba.set_bits())
+        visited.push_back(i);
+    ASSERT_EQ(visited, expected);
+
+    BitArray empty(1000);
+    ASSERT_EQ(empty.set_bits().begin(), empty.set_bits().end());
+
+    BitArray full(130);
+    full.set();
+    int n = 0;
+    for (int i : full.set_bits())
+        ASSERT_EQ(i, n++);
+    ASSERT_EQ(n, 130);
+}
+
+
+TEST(RoaringBitmapTest, SetTestCount) 
+{
+    RoaringBitmap rb(1000000000);
+    ASSERT_TRUE(rb.none());
+    rb.set(0).set(65535).set(65536).set(999999999);
+    ASSERT_EQ(rb.count(), 4);
+    ASSERT_TRUE(rb[65536]);
+    ASSERT_FALSE(rb[65537]);
+
+    rb.reset(65536);
+    ASSERT_EQ(rb.count(), 3);
+    ASSERT_FALSE(rb.test(65536));
+    ASSERT_THROW(rb.set(1000000000), std::out_of_range);
+    ASSERT_THROW(RoaringBitmap(RoaringBitmap::max_bits + 1), std::invalid_argument);
+}
+
+
+TEST(RoaringBitmapTest, ArrayBecomesBitmapAndBack) 
+{
+    RoaringBitmap rb(1 << 20);
+    for (int i = 0; i < 10000; ++i)
+        rb.set(2 * i);
+    ASSERT_EQ(rb.count(), 10000);
+    ASSERT_TRUE(rb[19998]);
+    ASSERT_FALSE(rb[19999]);
+
+    for (int i = 0; i < 9000; ++i)
+        rb.reset(2 * i);
+    ASSERT_EQ(rb.count(), 1000);
+    ASSERT_TRUE(rb[18000]);
+    ASSERT_FALSE(rb[17998]);
+}
+
+
+TEST(RoaringBitmapTest, RunOptimize) 
+{
+    RoaringBitmap rb(1 << 20);
+    for (int i = 100; i < 60000; ++i)
+        rb.set(i);
+    size_t before = rb.memory_usage();
+    rb.run_optimize();
+    ASSERT_LT(rb.memory_usage(), before / 100);
+    ASSERT_EQ(rb.count(), 59900);
+
+    // Mutating runs keeps them consistent
+    rb.reset(500);
+    rb.set(99);
+    rb.set(60000);
+    ASSERT_EQ(rb.count(), 59901);
+    ASSERT_FALSE(rb[500]);
+    ASSERT_TRUE(rb[99]);
+    ASSERT_TRUE(rb[501]);
+    rb.set(500);
+    ASSERT_EQ(rb.count(), 59902);
+
+    RoaringBitmap other(1 << 20);
+    for (int i = 50000; i < 70000; ++i)
+        other.set(i);
+    other.run_optimize();
+    rb.run_optimize();
+    ASSERT_EQ((rb & other).count(), 10001);
+    ASSERT_EQ((rb | other).count(), 69901);
+    ASSERT_EQ((rb ^ other).count(), 69901 - 10001);
+
+    // A small mixed union stays an array instead of an 8KB bitmap
+    RoaringBitmap run(1 << 20), array(1 << 20);
+    for (int i = 0; i < 100; ++i) {
+        run.set(i);
+        array.set(1000 + 7 * i);
+    }
+    run.run_optimize();
+    RoaringBitmap both = run | array;
+    ASSERT_EQ(both.count(), 200);
+    ASSERT_LT(both.memory_usage(), 1024);
+    ASSERT_LT((array | run).memory_usage(), 1024);
+}
+
+
+TEST(RoaringBitmapTest, OperatorsMatchBitArray) 
+{
+    std::mt19937_64 rng(11);
+    const int n = 300000;
+    BitArray a(n), b(n);
+    for (int i = 0; i < 2000; ++i)
+        a.set(rng() % n);
+    for (int i = 0; i < 90000; ++i)
+        b.set(rng() % n);
+    for (int i = 150000; i < 200000; ++i)
+        a.set(i);
+
+    RoaringBitmap ra(a), rb(b);
+    ASSERT_EQ(ra.count(), a.count());
+    ASSERT_EQ(ra.to_bit_array(), a);
+
+    BitArray and_ab = a & b, or_ab = a | b, xor_ab = a ^ b;
+    ASSERT_EQ((ra & rb).to_bit_array(), and_ab);
+    ASSERT_EQ((ra | rb).to_bit_array(), or_ab);
+    ASSERT_EQ((ra ^ rb).to_bit_array(), xor_ab);
+
+    ra.run_optimize();
+    rb.run_optimize();
+    ASSERT_EQ((ra & rb).to_bit_array(), and_ab);
+    ASSERT_EQ((ra | rb).to_bit_array(), or_ab);
+    ASSERT_EQ((ra ^ rb).to_bit_array(), xor_ab);
+    ASSERT_EQ(ra | rb, RoaringBitmap(or_ab));
+
+    ra ^= ra;
+    ASSERT_TRUE(ra.none());
+    ASSERT_THROW(ra &= RoaringBitmap(n + 1), std::invalid_argument);
+}
+
+
+TEST(AtomicBitArrayTest, SingleThreaded) 
+{
+    AtomicBitArray ba(130);
+    ASSERT_TRUE(ba.none());
+    ASSERT_FALSE(ba.test_and_set(129));
+    ASSERT_TRUE(ba.test_and_set(129));
+    ba.set(3, true, std::memory_order_relaxed);
+    ASSERT_EQ(ba.count(), 2);
+    ASSERT_TRUE(ba.fetch_reset(3));
+    ASSERT_FALSE(ba.fetch_reset(3));
+    ASSERT_FALSE(ba[3]);
+    ASSERT_THROW(ba.set(130), std::out_of_range);
+
+    BitArray snap = ba.snapshot();
+    ASSERT_THROW((void)ba.snapshot(std::memory_order_release), std::invalid_argument);
+    ASSERT_THROW((void)ba.test(129, std::memory_order_acq_rel), std::invalid_argument);
+    ASSERT_EQ(snap.size(), 130);
+    ASSERT_EQ(snap.count(), 1);
+    ASSERT_TRUE(snap[129]);
+
+    AtomicBitArray copy(snap);
+    ASSERT_TRUE(copy.test(129));
+}
+
+
+TEST(AtomicBitArrayTest, ConcurrentTestAndSet) 
+{
+    const size_t n = 100000;
+    AtomicBitArray visited(n);
+    std::atomic<size_t> first_visits{0};
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) 
+    {
+        workers.emplace_back([&, t] {
+            for (size_t i = 0; i < n; ++i) 
+            {
+                size_t node = (i * 7 + t * 13) % n;
+                if (!visited.test_and_set(node, std::memory_order_relaxed))
+                    first_visits.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    ASSERT_EQ(first_visits.load(), n);
+    ASSERT_EQ(visited.count(), n);
+    ASSERT_EQ(visited.snapshot().count(), n);
+}
+
+
+TEST(BitArrayTest, ParallelBulkOperations) 
+{
+    std::mt19937_64 rng(3);
+    const int n = 1 << 20;
+    BitArray a(n), b(n);
+    for (int i = 0; i < 50000; ++i) 
+    {
+        a.set(rng() % n);
+        b.set(rng() % n);
+    }
+
+    ParallelPolicy policy{4, 64};
+    ASSERT_EQ(a.count(policy), a.count());
+
+    BitArray expected = a & b, actual(a);
+    actual.and_with(b, policy);
+    ASSERT_EQ(actual, expected);
+    expected = a | b;
+    actual = a;
+    actual.or_with(b, policy);
+    ASSERT_EQ(actual, expected);
+    expected = a ^ b;
+    actual = a;
+    actual.xor_with(b, policy);
+    ASSERT_EQ(actual, expected);
+    ASSERT_THROW(actual.and_with(BitArray(5), policy), std::invalid_argument);
+
+    BitArray sparse(n);
+    ASSERT_FALSE(sparse.any(policy));
+    sparse.set(n - 1);
+    ASSERT_TRUE(sparse.any(policy));
+    ASSERT_TRUE(sparse.any(ParallelPolicy{}));
+    ASSERT_EQ(BitArray().count(policy), 0);
+}
+
+
+TEST(MappedBitArrayTest, PersistsBetweenOpens) 
+{
+    std::string path = (std::filesystem::temp_directory_path() / "mapped_bitarray_persist.bin").string();
+    {
+        MappedBitArray mapped = MappedBitArray::create(path, 100000);
+        ASSERT_EQ(mapped.size(), 100000);
+        ASSERT_FALSE(mapped.any());
+        mapped.set(0).set(77777).set(99999);
+        ASSERT_FALSE(mapped.verify());
+        mapped.flush();
+        ASSERT_TRUE(mapped.verify());
+        mapped.set(5);
+    }
+
+    MappedBitArray reopened = MappedBitArray::open(path, MappedBitArray::Mode::read_only);
+    ASSERT_TRUE(reopened.verify());
+    ASSERT_EQ(reopened.count(), 4);
+    ASSERT_TRUE(reopened[77777]);
+    ASSERT_THROW(reopened.set(1), std::logic_error);
+    ASSERT_THROW(reopened.test(100000), std::out_of_range);
+
+    BitArray copy = reopened.to_bit_array();
+    ASSERT_EQ(copy.count(), 4);
+    ASSERT_TRUE(copy[5]);
+
+    // Raw writes leave the checksum stale on disk until a flush()
+    {
+        MappedBitArray writable = MappedBitArray::open(path);
+        writable.data()[0] |= 2;
+        ASSERT_TRUE(writable.checksum_is_stale());
+    }
+    MappedBitArray stale = MappedBitArray::open(path);
+    ASSERT_TRUE(stale.checksum_is_stale());
+    ASSERT_FALSE(stale.verify());
+    ASSERT_EQ(stale.count(), 5);
+    stale.flush();
+    ASSERT_FALSE(stale.checksum_is_stale());
+    ASSERT_TRUE(stale.verify());
+    stale.reset(1);
+    stale.set(99999, false);
+    stale.flush();
+    ASSERT_TRUE(stale.verify());
+    std::filesystem::remove(path);
+}
+
+
+TEST(MappedBitArrayTest, RoundTripsBitArray) 
+{
+    std::string path = (std::filesystem::temp_directory_path() / "mapped_bitarray_roundtrip.bin").string();
+    BitArray ba(130);
+    ba.set(0).set(64).set(129);
+    {
+        MappedBitArray mapped = MappedBitArray::create(path, ba);
+        ASSERT_EQ(mapped.count(), 3);
+    }
+    ASSERT_EQ(MappedBitArray::open(path).to_bit_array(), ba);
+    std::filesystem::remove(path);
+}
+
+
+TEST(MappedBitArrayTest, RejectsBadFiles) 
+{
+    std::string path = (std::filesystem::temp_directory_path() / "mapped_bitarray_bad.bin").string();
+    MappedBitArray::create(path, 1000).set(10);
+
+    // Flipping a header byte breaks the header checksum
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offsetof(MappedBitArrayHeader, num_bits));
+        file.put(static_cast<char>(0xff));
+    }
+    ASSERT_THROW(MappedBitArray::open(path), std::runtime_error);
+
+    // A size near 2^64 with a valid header checksum must not wrap the file size
+    MappedBitArray::create(path, 1000);
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        MappedBitArrayHeader header{};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        header.num_bits = ~std::uint64_t(0) - 10;
+        std::uint64_t hash = 0xcbf29ce484222325ULL;  // FNV-1a, as the header checksum
+        const auto* bytes = reinterpret_cast<const unsigned char*>(&header);
+        for (size_t i = 0; i < offsetof(MappedBitArrayHeader, header_checksum); ++i)
+            hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+        header.header_checksum = hash;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    ASSERT_THROW(MappedBitArray::open(path), std::runtime_error);
+    ASSERT_THROW(MappedBitArray::create(path, ~size_t(0)), std::invalid_argument);
+
+    // A damaged data word still opens, but fails verification
+    MappedBitArray::create(path, 1000).set(10);
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(sizeof(MappedBitArrayHeader));
+        file.put(static_cast<char>(0xff));
+    }
+    MappedBitArray damaged = MappedBitArray::open(path);
+    ASSERT_FALSE(damaged.verify());
+
+    std::ofstream(path) << "not a bitmap";
+    ASSERT_THROW(MappedBitArray::open(path), std::runtime_error);
+    ASSERT_THROW(MappedBitArray::open(path + ".missing"), std::system_error);
+    std::filesystem::remove(path);
+}
+
+
+TEST(FixedBitArrayTest, ConstexprOperations) 
+{
+    constexpr FixedBitArray<256> a = FixedBitArray<256>(0b1011).set(200);
+    constexpr FixedBitArray<256> b = (a << 70) >> 6;
+    static_assert(a.count() == 4);
+    static_assert(b[67] && b[64] && !b[66]);
+    static_assert(b.count() == 3);
+    static_assert((a & ~a).none());
+    static_assert((~FixedBitArray<100>()).count() == 100);
+    static_assert(FixedBitArray<8>(0x1ff).count() == 8);
+    static_assert(FixedBitArray<256>::size() == 256);
+    ASSERT_EQ((a ^ b).count(), 7);
+}
+
+
+TEST(FixedBitArrayTest, MatchesBitArray) 
+{
+    FixedBitArray<130> fixed;
+    BitArray dynamic(130);
+    for (int i : {0, 5, 63, 64, 100, 129}) 
+    {
+        fixed.set(i);
+        dynamic.set(i);
+    }
+    ASSERT_EQ(fixed.to_string(), dynamic.to_string());
+    ASSERT_EQ(fixed.to_bit_array(), dynamic);
+    ASSERT_EQ(FixedBitArray<130>(dynamic), fixed);
+
+    fixed <<= 1;
+    dynamic <<= 1;
+    ASSERT_EQ(fixed.to_bit_array(), dynamic);
+    fixed.set();
+    ASSERT_EQ(fixed.count(), 130);
+    ASSERT_THROW(fixed.set(130), std::out_of_range);
+    ASSERT_THROW(FixedBitArray<64>{dynamic}, std::invalid_argument);
+}
+
+
+// Sum of the set-bit indices, through the set-bit range
+template <size_t N>
+constexpr size_t sum_set_bits(const FixedBitArray<N>& a)
+{
+    size_t sum = 0;
+    for (size_t i : a.set_bits())
+        sum += i;
+    return sum;
+}
+
+
+TEST(FixedBitArrayTest, SearchRotateAndIterate)
+{
+    constexpr FixedBitArray<200> a = FixedBitArray<200>(0b100110).set(70).set(199);
+    static_assert(a.find_first() == 1);
+    static_assert(a.find_next(2) == 5);
+    static_assert(a.find_next(5) == 70);
+    static_assert(a.find_next(199) == BitArray::npos);
+    static_assert(a.find_last() == 199);
+    static_assert(FixedBitArray<200>().find_first() == BitArray::npos);
+    static_assert(sum_set_bits(a) == 1 + 2 + 5 + 70 + 199);
+    static_assert(FixedBitArray<200>(a).rotate_left(3).find_first() == 2);
+    static_assert(FixedBitArray<200>(a).rotate_right(203) == FixedBitArray<200>(a).rotate_left(197));
+
+    // Same results as BitArray
+    BitArray dynamic = a.to_bit_array();
+    for (size_t n : {0, 1, 63, 64, 130, 200, 450}) {
+        ASSERT_EQ(FixedBitArray<200>(a).rotate_left(n).to_bit_array(), BitArray(dynamic).rotate_left(n));
+        ASSERT_EQ(FixedBitArray<200>(a).rotate_right(n).to_bit_array(), BitArray(dynamic).rotate_right(n));
+    }
+    std::vector<size_t> fixed_bits, dynamic_bits;
+    for (size_t i : a.set_bits())
+        fixed_bits.push_back(i);
+    for (size_t i : dynamic.set_bits())
+        dynamic_bits.push_back(i);
+    ASSERT_EQ(fixed_bits, dynamic_bits);
+
+    size_t index = 0;
+    for (bool bit : a)
+        ASSERT_EQ(bit, dynamic[index++]);
+    ASSERT_EQ(index, 200);
+    ASSERT_THROW(a.find_next(200), std::out_of_range);
+}
+
+
+TEST(FixedBitArrayTest, RangesHexHashAndOrder)
+{
+    constexpr FixedBitArray<130> a = FixedBitArray<130>().set_range(60, 70).flip(0).flip_range(65, 129);
+    static_assert(a.count_range(0, 130) == a.count());
+    static_assert(a.count_range(60, 65) == 5);
+    static_assert(a.count() == 1 + 5 + 59);
+    static_assert(FixedBitArray<130>(a).reset_range(0, 130).none());
+    static_assert(FixedBitArray<130>(a).flip().count() == 130 - a.count());
+    static_assert(FixedBitArray<8>(0xab).to_hex() == "ab");
+    static_assert(FixedBitArray<130>::from_hex(a.to_hex()) == a);
+    static_assert(FixedBitArray<6>::from_hex("3F") == FixedBitArray<6>(0x3f));
+    static_assert(FixedBitArray<8>(0b10) > FixedBitArray<8>(0b1100));  // Bit 1 decides
+    static_assert(a.hash() == std::hash<FixedBitArray<130>>{}(a));
+
+    // Same results as BitArray
+    BitArray dynamic = a.to_bit_array();
+    for (auto [first, last] : {std::pair<size_t, size_t>{0, 0}, {3, 64}, {64, 128}, {1, 130}, {127, 130}}) {
+        ASSERT_EQ(a.count_range(first, last), dynamic.count_range(first, last));
+        ASSERT_EQ(FixedBitArray<130>(a).flip_range(first, last).to_bit_array(), BitArray(dynamic).flip_range(first, last));
+        ASSERT_EQ(FixedBitArray<130>(a).set_range(first, last).to_bit_array(), BitArray(dynamic).set_range(first, last));
+    }
+    ASSERT_EQ(a.to_hex(), dynamic.to_hex());
+    ASSERT_EQ(a.to_string(), dynamic.to_string());
+    ASSERT_EQ(a.hash(), dynamic.hash());
+
+    std::mt19937_64 rng(37);
+    for (int k = 0; k < 100; ++k) {
+        const FixedBitArray<130> x(rng()), y = FixedBitArray<130>(rng()) << 60;
+        ASSERT_EQ(x <=> y, x.to_bit_array() <=> y.to_bit_array());
+    }
+
+    ASSERT_THROW(FixedBitArray<130>(a).set_range(5, 131), std::out_of_range);
+    ASSERT_THROW((void)a.count_range(6, 5), std::out_of_range);
+    ASSERT_THROW(FixedBitArray<130>(a).flip(130), std::out_of_range);
+    ASSERT_THROW(FixedBitArray<6>::from_hex("7f"), std::invalid_argument);  // Bit 6 set
+    ASSERT_THROW(FixedBitArray<6>::from_hex("0g"), std::invalid_argument);
+    ASSERT_THROW(FixedBitArray<6>::from_hex("000"), std::invalid_argument);
+}
+
+
+TEST(BitArrayTest, MoveSemantics) 
+{
+    static_assert(std::is_nothrow_move_constructible_v<BitArray>);
+    static_assert(std::is_nothrow_move_assignable_v<BitArray>);
+
+    BitArray large(1000);
+    large.set(999);
+    const unsigned long* buffer = std::as_const(large).data();
+    BitArray moved(std::move(large));
+    ASSERT_EQ(std::as_const(moved).data(), buffer);
+    ASSERT_TRUE(moved[999]);
+    ASSERT_TRUE(large.empty());
+
+    BitArray small(10, 0b11);
+    large = std::move(small);
+    ASSERT_EQ(large.to_string(), "0000000011");
+    ASSERT_TRUE(small.empty());
+
+    moved = std::move(moved);
+    ASSERT_EQ(moved.count(), 1);
+    large.push_back(true);
+    ASSERT_EQ(large.size(), 11);
+}
+
+
+TEST(BitArrayTest, RvalueOperatorsReuseBuffer) 
+{
+    BitArray a(1000), b(1000);
+    a.set(1).set(500);
+    b.set(2).set(500);
+
+    BitArray temp(a);
+    const unsigned long* buffer = std::as_const(temp).data();
+    BitArray result = ~(std::move(temp) << 1) & b;
+    ASSERT_EQ(std::as_const(result).data(), buffer);
+    ASSERT_EQ(result.count(), 1);
+    ASSERT_TRUE(result[500]);
+
+    ASSERT_EQ((BitArray(a) | BitArray(b)).count(), 3);
+    ASSERT_EQ((a ^ BitArray(b)).count(), 2);
+    ASSERT_EQ((BitArray(a) & (a | b)).count(), 2);
+    ASSERT_EQ((BitArray(a) >> 1).count(), 2);
+    ASSERT_EQ((~BitArray(70)).count(), 70);
+    ASSERT_THROW(BitArray(a) & BitArray(5), std::invalid_argument);
+}
+
+
+// Counts the blocks handed out by an upstream resource
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t allocations = 0;
+    size_t live = 0;
+    size_t last_alignment = 0;
+
+private:
+    std::pmr::memory_resource* upstream = std::pmr::new_delete_resource();
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        last_alignment = alignment;
+        ++allocations;
+        ++live;
+        return upstream->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        --live;
+        upstream->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+
+TEST(BitArrayTest, MemoryResource)
+{
+    CountingResource arena;
+    {
+        BitArray small(100, 5, &arena);
+        ASSERT_EQ(arena.allocations, 0);  // Still inline
+        small.resize(1000, true);
+        ASSERT_EQ(arena.allocations, 1);
+        ASSERT_EQ(arena.last_alignment, 64);
+        ASSERT_EQ(small.get_allocator().resource(), &arena);
+        ASSERT_EQ(small.count(), 902);
+
+        // Copies use the default resource, moves keep the source's
+        BitArray copy(small);
+        ASSERT_EQ(copy.get_allocator().resource(), std::pmr::get_default_resource());
+        ASSERT_EQ(copy, small);
+        BitArray moved(std::move(small));
+        ASSERT_EQ(moved.get_allocator().resource(), &arena);
+        ASSERT_EQ(arena.live, 1);
+
+        // Copy assignment keeps the target's resource; a move with another resource copies
+        BitArray target(10, &arena);
+        target = copy;
+        ASSERT_EQ(target.get_allocator().resource(), &arena);
+        ASSERT_EQ(arena.live, 2);
+        BitArray other(std::move(copy), &arena);
+        ASSERT_EQ(other, moved);
+        ASSERT_EQ(arena.live, 3);
+
+        // Resources never change hands, so blocks cannot outlive their arena
+        target.swap(other);
+        ASSERT_EQ(target, moved);
+        ASSERT_EQ(target.get_allocator().resource(), &arena);
+    }
+    ASSERT_EQ(arena.live, 0);
+
+    // Moving out of a short-lived arena copies into the target's own resource
+    BitArray long_lived(10);
+    {
+        CountingResource request_arena;
+        BitArray temp(5000, 1, &request_arena);
+        temp.set(4999);
+        long_lived = std::move(temp);
+        ASSERT_TRUE(temp.empty());
+        ASSERT_EQ(request_arena.live, 0);
+
+        BitArray same(300, &request_arena);
+        const unsigned long* buffer = std::as_const(same).data();
+        BitArray taker(&request_arena);
+        taker = std::move(same);
+        ASSERT_EQ(std::as_const(taker).data(), buffer);
+    }
+    ASSERT_EQ(long_lived.get_allocator().resource(), std::pmr::get_default_resource());
+    ASSERT_EQ(long_lived.count(), 2);
+    ASSERT_TRUE(long_lived[4999]);
+
+    // Elements of a pmr container keep their container's resource when assigned
+    CountingResource arena_a, arena_b;
+    {
+        std::pmr::vector<BitArray> in_a(&arena_a);
+        in_a.emplace_back(1000, 3);
+        BitArray from_b(2000, 1, &arena_b);
+        in_a[0] = std::move(from_b);
+        ASSERT_EQ(in_a[0].get_allocator().resource(), &arena_a);
+        ASSERT_EQ(in_a[0].size(), 2000);
+        ASSERT_EQ(arena_b.live, 0);
+    }
+    ASSERT_EQ(arena_a.live, 0);
+
+    // Rotations keep to the array's resource, and small ones do not allocate
+    {
+        BitArray big(100000, 1, &arena);
+        big.set(99999);
+        const size_t before = arena.allocations;
+        big.rotate_left(100);
+        big.rotate_right(99);
+        ASSERT_EQ(arena.allocations, before);
+        ASSERT_TRUE(big[0] && big[1]);
+        big.rotate_left(30000);
+        ASSERT_EQ(arena.allocations, before + 1);
+        ASSERT_EQ(arena.live, 1);
+        ASSERT_EQ(big.count(), 2);
+    }
+
+    // pmr containers hand their resource to the arrays they hold
+    std::pmr::monotonic_buffer_resource pool(1 << 16);
+    std::pmr::vector<BitArray> arrays(&pool);
+    for (size_t i = 0; i < 20; ++i)
+        arrays.emplace_back(500 + i, 1);
+    arrays.push_back(BitArray(300));
+    for (const BitArray& ba : arrays) {
+        ASSERT_EQ(ba.get_allocator().resource(), &pool);
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(ba.data()) % 64, 0);
+        ASSERT_EQ(ba.count(), ba.size() == 300 ? 0 : 1);
+    }
+}
+
+TEST(BloomFilterTest, NoFalseNegativesAndTargetRate)
+{
+    const size_t n = 20000;
+    BloomFilter::Parameters p = BloomFilter::optimal_parameters(n, 0.01);
+    ASSERT_EQ(p.num_hashes, 7);
+    ASSERT_NEAR(static_cast<double>(p.num_bits) / n, 9.59, 0.01);
+
+    BloomFilter filter = BloomFilter::with_capacity(n, 0.01);
+    ASSERT_EQ(filter.size() % BloomFilter::block_bits, 0);
+    ASSERT_GE(filter.size(), p.num_bits);
+
+    std::mt19937_64 rng(21);
+    std::vector<std::uint64_t> keys(n);
+    for (std::uint64_t& key : keys) key = rng();
+    filter.insert_many(std::span<const std::uint64_t>(keys).first(n / 2));
+    for (size_t j = n / 2; j < n; ++j)
+        filter.insert(keys[j]);
+
+    std::vector<std::uint8_t> found(n);
+    filter.contains_many(keys, found);
+    for (size_t j = 0; j < n; ++j) {
+        ASSERT_TRUE(found[j]);
+        ASSERT_TRUE(filter.contains(keys[j]));
+    }
+
+    // Blocking costs a little accuracy, so allow up to twice the target
+    size_t false_positives = 0;
+    const size_t probes = 100000;
+    for (size_t j = 0; j < probes; ++j)
+        false_positives += filter.contains(rng());
+    ASSERT_LT(false_positives, probes * 2 / 100);
+
+    filter.clear();
+    ASSERT_FALSE(filter.contains(keys[0]));
+
+    // Batches shorter and longer than the prefetch window match the single-key calls
+    for (size_t m : {0, 1, 5, 8, 9, 20}) {
+        BloomFilter small(4096, 3);
+        small.insert_many(std::span<const std::uint64_t>(keys).first(m));
+        std::vector<std::uint8_t> hits(2 * m);
+        small.contains_many(std::span<const std::uint64_t>(keys).first(2 * m), hits);
+        for (size_t j = 0; j < 2 * m; ++j)
+            ASSERT_EQ(hits[j], small.contains(keys[j]));
+        ASSERT_EQ(small.bit_array().count() == 0, m == 0);
+    }
+    ASSERT_THROW(BloomFilter(1000, 0), std::invalid_argument);
+    ASSERT_THROW(BloomFilter::optimal_parameters(10, 1.0), std::invalid_argument);
+}
+
+
+TEST(BloomFilterTest, SerializationRoundTrip)
+{
+    BloomFilter filter(3000, 5);
+    for (std::uint64_t key = 0; key < 300; ++key)
+        filter.insert(key * 7919);
+
+    std::vector<std::uint8_t> image = filter.serialize();
+    ASSERT_EQ(image.size(), 24 + filter.size() / 8);
+    BloomFilter copy = BloomFilter::deserialize(image);
+    ASSERT_EQ(copy, filter);
+    ASSERT_EQ(copy.hash_count(), 5);
+    ASSERT_TRUE(copy.contains(7919));
+
+    std::vector<std::uint8_t> truncated(image.begin(), image.end() - 1);
+    ASSERT_THROW(BloomFilter::deserialize(truncated), std::invalid_argument);
+    image[0] = 'X';
+    ASSERT_THROW(BloomFilter::deserialize(image), std::invalid_argument);
+}
+
+
+// Random matrix with about one bit in density set
+static BitMatrix random_matrix(size_t rows, size_t cols, std::mt19937_64& rng, unsigned density = 3)
+{
+    BitMatrix m(rows, cols);
+    for (size_t r = 0; r < rows; ++r)
+        for (size_t c = 0; c < cols; ++c)
+            if (rng() % density == 0)
+                m.set(r, c);
+    return m;
+}
+
+
+TEST(BitMatrixTest, TransposeMatchesPerBit)
+{
+    std::mt19937_64 rng(3);
+    for (auto [rows, cols] : {std::pair<size_t, size_t>{1, 1}, {64, 64}, {70, 130}, {200, 9}, {0, 5}}) {
+        BitMatrix m = random_matrix(rows, cols, rng);
+        BitMatrix t = m.transposed();
+        ASSERT_EQ(t.rows(), cols);
+        ASSERT_EQ(t.cols(), rows);
+        ASSERT_EQ(t.count(), m.count());
+        for (size_t r = 0; r < rows; ++r)
+            for (size_t c = 0; c < cols; ++c)
+                ASSERT_EQ(t(c, r), m(r, c));
+        ASSERT_EQ(t.transposed(), m);
+    }
+}
+
+
+TEST(BitMatrixTest, RowAndColumnViews)
+{
+    BitMatrix m(3, 100);
+    m.set(0, 5).set(0, 99).set(1, 5).set(2, 70);
+    ASSERT_EQ(m.row(0).count(), 2);
+    ASSERT_EQ(m.column(5).count(), 2);
+    ASSERT_EQ(m.column(5).to_bit_array().to_string(), "011");
+    ASSERT_EQ(m.row_words(), 2);
+
+    m.or_row(1, 2);
+    ASSERT_TRUE(m(1, 70));
+    m.and_row(0, 1);
+    ASSERT_EQ(m.row(0).to_bit_array().count(), 1);
+    ASSERT_TRUE(m.row(0)[5]);
+
+    BitArray mask(100);
+    mask.set();
+    m.row(2) |= mask;
+    ASSERT_EQ(m.row(2).count(), 100);
+    ASSERT_EQ(m.count(), 1 + 2 + 100);
+    m.set_row(2, BitArray(100, 6));
+    ASSERT_EQ(m.row(2).count(), 2);
+
+    ASSERT_THROW(m.row(3), std::out_of_range);
+    ASSERT_THROW(m.set(0, 100), std::out_of_range);
+    ASSERT_THROW(m.row(0) |= BitArray(99), std::invalid_argument);
+}
+
+
+TEST(BitMatrixTest, MultiplyMatchesNaive)
+{
+    std::mt19937_64 rng(4);
+    BitMatrix a = random_matrix(45, 77, rng, 9);
+    BitMatrix b = random_matrix(77, 130, rng, 9);
+    BitMatrix c = multiply(a, b);
+    ASSERT_EQ(c.rows(), 45);
+    ASSERT_EQ(c.cols(), 130);
+    for (size_t i = 0; i < 45; ++i) {
+        for (size_t j = 0; j < 130; ++j) {
+            bool expected = false;
+            for (size_t k = 0; k < 77; ++k)
+                expected |= a(i, k) && b(k, j);
+            ASSERT_EQ(c(i, j), expected);
+        }
+    }
+    ASSERT_EQ(multiply(BitMatrix::identity(45), a), a);
+    ASSERT_THROW(multiply(a, a), std::invalid_argument);
+}
+
+
+TEST(PackedIntArrayTest, GetSetAcrossWords)
+{
+    std::mt19937_64 rng(12);
+    for (unsigned width : {1u, 3u, 5u, 12u, 33u, 64u}) {
+        const std::uint64_t mask = width == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << width) - 1;
+        PackedIntArray packed(width);
+        std::vector<std::uint64_t> naive;
+        for (int i = 0; i < 500; ++i) {
+            naive.push_back(rng() & mask);
+            packed.push_back(naive.back());
+        }
+        for (int round = 0; round < 500; ++round) {
+            size_t i = rng() % naive.size();
+            naive[i] = rng() & mask;
+            packed.set(i, naive[i]);
+        }
+
+        ASSERT_EQ(packed.size(), naive.size());
+        ASSERT_EQ(packed.bit_array().size(), naive.size() * width);
+        for (size_t i = 0; i < naive.size(); ++i)
+            ASSERT_EQ(packed[i], naive[i]);
+    }
+
+    PackedIntArray codes(5, 10, 17);
+    ASSERT_EQ(codes.get(9), 17);
+    codes.resize(12, 3);
+    ASSERT_EQ(codes.get(9), 17);
+    ASSERT_EQ(codes.get(11), 3);
+    ASSERT_THROW(codes.set(0, 32), std::invalid_argument);
+    ASSERT_THROW(codes.get(12), std::out_of_range);
+    ASSERT_THROW(PackedIntArray(0), std::invalid_argument);
+    ASSERT_THROW(PackedIntArray(65), std::invalid_argument);
+}
+
+
+TEST(PackedIntArrayTest, UnpackMatchesGet)
+{
+    std::mt19937_64 rng(13);
+    for (unsigned width : {1u, 3u, 7u, 8u, 12u, 15u, 16u}) {
+        PackedIntArray packed(width, 1000);
+        for (size_t i = 0; i < packed.size(); ++i)
+            packed.set(i, rng() & ((std::uint64_t(1) << width) - 1));
+
+        for (size_t first : {0, 1, 5, 990}) {
+            std::vector<std::uint16_t> wide(packed.size() - first);
+            packed.unpack(first, wide);
+            for (size_t j = 0; j < wide.size(); ++j)
+                ASSERT_EQ(wide[j], packed[first + j]);
+
+            if (width <= 8) {
+                std::vector<std::uint8_t> narrow(packed.size() - first);
+                packed.unpack(first, narrow);
+                for (size_t j = 0; j < narrow.size(); ++j)
+                    ASSERT_EQ(narrow[j], packed[first + j]);
+            }
+        }
+    }
+
+    PackedIntArray packed(12, 10);
+    std::vector<std::uint8_t> narrow(4);
+    ASSERT_THROW(packed.unpack(0, narrow), std::invalid_argument);
+    std::vector<std::uint16_t> wide(4);
+    ASSERT_THROW(packed.unpack(7, wide), std::out_of_range);
+}
+
+
+TEST(CowBitArrayTest, SnapshotsShareUntilWritten)
+{
+    BitArray source(200000);
+    for (size_t i = 0; i < source.size(); i += 1001)
+        source.set(i);
+    CowBitArray live(source);
+    ASSERT_EQ(live.to_bit_array(), source);
+    ASSERT_EQ(live.count(), source.count());
+
+    const size_t pages = (source.size() + CowBitArray::page_bits - 1) / CowBitArray::page_bits;
+    CowBitArray snap = live.snapshot();
+    ASSERT_EQ(snap.shared_pages(live), pages);
+
+    // One write clones one page; the snapshot keeps the old contents
+    live.set(5).reset(0);
+    ASSERT_EQ(snap.shared_pages(live), pages - 1);
+    ASSERT_TRUE(snap[0]);
+    ASSERT_FALSE(snap[5]);
+    ASSERT_TRUE(live[5]);
+    ASSERT_EQ(snap.to_bit_array(), source);
+
+    // Writing a bit's current value does not unshare anything
+    CowBitArray second = live.snapshot();
+    live.set(5);
+    live.reset(1);
+    ASSERT_EQ(second.shared_pages(live), pages);
+
+    CowBitArray moved(std::move(second));
+    ASSERT_EQ(second.size(), moved.size());
+    ASSERT_EQ(moved.count(), live.count());
+    ASSERT_THROW(live.set(source.size()), std::out_of_range);
+}
+
+
+TEST(CowBitArrayTest, LargeSparseArray)
+{
+    // Untouched pages share one zero page, so 10^10 bits cost a few MB of tables
+    const size_t n = 10000000000ULL;
+    CowBitArray big(n);
+    ASSERT_TRUE(big.none());
+    big.set(n - 1);
+    big.set(1ULL << 33);
+    CowBitArray snap = big.snapshot();
+    big.reset(n - 1);
+    ASSERT_EQ(big.count(), 1);
+    ASSERT_EQ(snap.count(), 2);
+    ASSERT_TRUE(snap.test(n - 1));
+}
+
+
+// Runs of empty and full words with a few random literals in between
+static BitArray runny_array(size_t n, std::mt19937_64& rng)
+{
+    BitArray ba(n);
+    for (size_t i = 0; i < n;) {
+        size_t len = std::min<size_t>(n - i, rng() % 2000);
+        switch (rng() % 3) {
+        case 0:
+            i += len;
+            break;
+        case 1:
+            ba.set_range(i, i + len);
+            i += len;
+            break;
+        default:
+            for (size_t end = std::min(n, i + 64); i < end; ++i)
+                ba.set(i, rng() & 1);
+        }
+    }
+    return ba;
+}
+
+
+TEST(EwahBitmapTest, RoundTripAndMerge)
+{
+    std::mt19937_64 rng(50);
+    for (size_t n : {0, 1, 64, 100, 5000, 70000}) {
+        BitArray a = runny_array(n, rng), b = runny_array(n, rng);
+        EwahBitmap ea(a), eb(b);
+        ASSERT_EQ(ea.to_bit_array(), a);
+        ASSERT_EQ(ea.count(), a.count());
+        ASSERT_EQ(EwahBitmap::deserialize(ea.serialize()), ea);
+
+        // Merged streams are the canonical encodings of the merged arrays
+        ASSERT_EQ(ea & eb, EwahBitmap(a & b));
+        ASSERT_EQ(ea | eb, EwahBitmap(a | b));
+        ASSERT_EQ((ea & eb).to_bit_array(), a & b);
+    }
+
+    // Runs cost one marker
+    BitArray full(1 << 20);
+    full.set();
+    ASSERT_EQ(EwahBitmap(full).compressed().size(), 1);
+    ASSERT_EQ(EwahBitmap(BitArray(1 << 20)).compressed().size(), 1);
+    ASSERT_EQ((EwahBitmap(full) & EwahBitmap(BitArray(1 << 20))).count(), 0);
+    ASSERT_THROW(EwahBitmap(full) | EwahBitmap(BitArray(10)), std::invalid_argument);
+}
+
+
+TEST(EwahBitmapTest, StreamingWriterAndReader)
+{
+    std::mt19937_64 rng(51);
+    BitArray a = runny_array(100000, rng);
+
+    // Drain the writer as it goes, then read back in small chunks
+    EwahWriter writer;
+    std::vector<std::uint64_t> shipped;
+    const std::span<const std::uint64_t> words(a.data(), a.word_count());
+    for (size_t i = 0; i < words.size(); i += 100) {
+        writer.add_words(words.subspan(i, std::min<size_t>(100, words.size() - i)));
+        shipped.insert(shipped.end(), writer.completed().begin(), writer.completed().end());
+        writer.discard_completed();
+    }
+    shipped.insert(shipped.end(), writer.stream().begin(), writer.stream().end());
+    ASSERT_EQ(writer.word_count(), a.word_count());
+    ASSERT_THROW((void)writer.finish(a.size()), std::logic_error);
+    ASSERT_TRUE(std::ranges::equal(shipped, EwahBitmap(a).compressed()));
+
+    EwahReader reader(shipped);
+    std::vector<std::uint64_t> decoded, chunk(37);
+    while (size_t n = reader.read(chunk))
+        decoded.insert(decoded.end(), chunk.begin(), chunk.begin() + n);
+    ASSERT_TRUE(std::ranges::equal(decoded, words));
+
+    // Runs can be added without expanding them; the size must match the words
+    EwahWriter runs;
+    runs.add_run(true, 3);
+    runs.add_word(0x5);
+    runs.add_run(false, 1);
+    ASSERT_THROW((void)runs.finish(64 * 5 + 1), std::invalid_argument);
+    EwahBitmap e = runs.finish(64 * 5);
+    ASSERT_EQ(e.count(), 3 * 64 + 2);
+    ASSERT_EQ(e.compressed().size(), 3);  // Ones and the literal share a marker
+
+    // Truncated and mislabelled images are rejected
+    std::vector<std::uint8_t> bytes = EwahBitmap(a).serialize();
+    ASSERT_THROW(EwahBitmap::deserialize(std::span(bytes).first(bytes.size() - 8)), std::invalid_argument);
+    bytes[17] ^= 1;  // 256 more bits than the stream holds
+    ASSERT_THROW(EwahBitmap::deserialize(bytes), std::invalid_argument);
+    bytes[0] = 'X';
+    ASSERT_THROW(EwahBitmap::deserialize(bytes), std::invalid_argument);
+}
+
+
+TEST(EwahBitmapTest, StreamingMerge)
+{
+    std::mt19937_64 rng(52);
+    BitArray a = runny_array(200000, rng), b = runny_array(200000, rng);
+    const EwahBitmap ea(a), eb(b);
+
+    // Merge straight from the compressed streams, shipping the output as it completes
+    for (bool is_and : {true, false}) {
+        EwahReader x(ea.compressed()), y(eb.compressed());
+        EwahWriter out;
+        if (is_and)
+            EwahBitmap::merge_and(x, y, out);
+        else
+            EwahBitmap::merge_or(x, y, out);
+        ASSERT_TRUE(x.done() && y.done());
+        ASSERT_EQ(out.word_count(), a.word_count());
+        std::vector<std::uint64_t> shipped(out.completed().begin(), out.completed().end());
+        out.discard_completed();
+        shipped.insert(shipped.end(), out.stream().begin(), out.stream().end());
+        ASSERT_TRUE(std::ranges::equal(shipped, (is_and ? ea & eb : ea | eb).compressed()));
+    }
+
+    // Readers part-way through merge what is left of them
+    EwahReader x(ea.compressed()), y(eb.compressed());
+    x.skip(1000);
+    y.skip(1000);
+    EwahWriter out;
+    for (size_t i = 0; i < 1000; ++i)
+        out.add_word(a.data()[i] & b.data()[i]);
+    EwahBitmap::merge_and(x, y, out);
+    ASSERT_EQ(out.finish(a.size()), ea & eb);
+
+    // Streams of different lengths are rejected
+    const EwahBitmap shorter(BitArray(100000));
+    EwahReader s(shorter.compressed()), t(ea.compressed());
+    EwahWriter ignored;
+    ASSERT_THROW(EwahBitmap::merge_or(s, t, ignored), std::invalid_argument);
+}
@@ -0,0 +1,200 @@
+#include "bloom_filter.h"
+#include "hash_mix.h"
+#include "serial_io.h"
+#include <cmath>
+
+static constexpr char serial_magic[8] = {'B', 'L', 'O', 'O', 'M', 'F', 'L', 'T'};
+static constexpr std::uint32_t serial_version = 1;
+static constexpr size_t prefetch_distance = 8;  // Keys ahead whose block is prefetched
+
+
+BloomFilter::Parameters BloomFilter::optimal_parameters(size_t expected_elements, double false_positive_rate)
+{
+    if (!(false_positive_rate > 0 && false_positive_rate < 1))
+        throw std::invalid_argument("False-positive rate must be between 0 and 1");
+
+    const double n = static_cast<double>(std::max<size_t>(expected_elements, 1));
+    const double ln2 = std::log(2.0);
+    const double m = std::ceil(-n * std::log(false_positive_rate) / (ln2 * ln2));
+    const double k = std::round(m / n * ln2);
+    return {static_cast<size_t>(m), static_cast<unsigned>(std::clamp(k, 1.0, double(max_hashes)))};
+}
+
+
+BloomFilter::BloomFilter(size_t num_bits, unsigned num_hashes)
+    : num_blocks(std::max<size_t>(1, (num_bits + block_bits - 1) / block_bits)), num_hashes(num_hashes)
+{
+    if (num_hashes < 1 || num_hashes > max_hashes)
+        throw std::invalid_argument("Hash count must be between 1 and 16");
+    bits.resize(num_blocks * block_bits);
+}
+
+
+BloomFilter BloomFilter::with_capacity(size_t expected_elements, double false_positive_rate)
+{
+    Parameters p = optimal_parameters(expected_elements, false_positive_rate);
+    return BloomFilter(p.num_bits, p.num_hashes);
+}
+
+
+size_t BloomFilter::block_of(std::uint64_t hash) const
+{
+    // Multiply-shift maps the hash onto [0, num_blocks) without a division
+    return static_cast<size_t>((static_cast<unsigned __int128>(hash) * num_blocks) >> 64) * block_words;
+}
+
+
+void BloomFilter::block_mask(std::uint64_t hash, std::uint64_t (&mask)[block_words]) const
+{
+    // block_of() depends mostly on the high bits of the hash, so the probes
+    // come from the low ones; h2 is odd, so the probes never repeat a bit
+    const std::uint32_t h1 = static_cast<std::uint32_t>(hash);
+    const std::uint32_t h2 = static_cast<std::uint32_t>(hash >> 23) | 1;
+    std::fill(mask, mask + block_words, 0);
+    for (unsigned i = 0; i < num_hashes; ++i) {
+        std::uint32_t pos = (h1 + i * h2) % block_bits;
+        mask[pos / 64] |= std::uint64_t(1) << (pos % 64);
+    }
+}
+
+
+void BloomFilter::insert(std::uint64_t key)
+{
+    insert_hash(murmur_mix(key));
+}
+
+
+bool BloomFilter::contains(std::uint64_t key) const
+{
+    return contains_hash(murmur_mix(key));
+}
+
+
+void BloomFilter::insert_hash(std::uint64_t hash)
+{
+    std::uint64_t mask[block_words];
+    block_mask(hash, mask);
+    unsigned long* block = bits.data() + block_of(hash);
+    for (size_t w = 0; w < block_words; ++w)
+        block[w] |= mask[w];
+}
+
+
+bool BloomFilter::contains_hash(std::uint64_t hash) const
+{
+    std::uint64_t mask[block_words];
+    block_mask(hash, mask);
+    const unsigned long* block = bits.data() + block_of(hash);
+    // No early exit: eight independent and-compares vectorize
+    std::uint64_t missing = 0;
+    for (size_t w = 0; w < block_words; ++w)
+        missing |= mask[w] & ~block[w];
+    return missing == 0;
+}
+
+
+// Calls visit(j, hash) for every key in order, with the blocks of the next
+// prefetch_distance keys prefetched through prefetch(hash). Each key is mixed
+// once: the hashes of the keys in flight wait in a ring until their turn.
+template <typename Prefetch, typename Visit>
+static void for_each_hash(std::span<const std::uint64_t> keys, Prefetch prefetch, Visit visit)
+{
+    std::uint64_t ahead[prefetch_distance];
+    for (size_t j = 0; j < std::min(prefetch_distance, keys.size()); ++j) {
+        ahead[j] = murmur_mix(keys[j]);
+        prefetch(ahead[j]);
+    }
+    for (size_t j = 0; j < keys.size(); ++j) {
+        std::uint64_t& slot = ahead[j % prefetch_distance];
+        const std::uint64_t hash = slot;
+        if (j + prefetch_distance < keys.size()) {
+            slot = murmur_mix(keys[j + prefetch_distance]);
+            prefetch(slot);
+        }
+        visit(j, hash);
+    }
+}
+
+
+void BloomFilter::insert_many(std::span<const std::uint64_t> keys)
+{
+    unsigned long* words = bits.data();
+    for_each_hash(keys,
+        [&](std::uint64_t hash) { __builtin_prefetch(words + block_of(hash), 1); },
+        [&](size_t, std::uint64_t hash) { insert_hash(hash); });
+}
+
+
+void BloomFilter::contains_many(std::span<const std::uint64_t> keys, std::span<std::uint8_t> out) const
+{
+    if (out.size() < keys.size()) throw std::length_error("Buffer is too small");
+
+    const unsigned long* words = bits.data();
+    for_each_hash(keys,
+        [&](std::uint64_t hash) { __builtin_prefetch(words + block_of(hash), 0); },
+        [&](size_t j, std::uint64_t hash) { out[j] = contains_hash(hash); });
+}
+
+
+void BloomFilter::clear()
+{
+    bits.reset();
+}
+
+
+size_t BloomFilter::size() const
+{
+    return bits.size();
+}
+
+
+unsigned BloomFilter::hash_count() const
+{
+    return num_hashes;
+}
+
+
+const BitArray& BloomFilter::bit_array() const
+{
+    return bits;
+}
+
+
+std::vector<std::uint8_t> BloomFilter::serialize() const
+{
+    std::vector<std::uint8_t> out = start_serial_header(serial_magic, serial_version);
+    put_le(out, num_hashes, 4);
+    put_le(out, num_blocks, 8);
+    out.resize(serial_header_size + bits.byte_size());
+    bits.write_bytes(std::span<std::uint8_t>(out).subspan(serial_header_size));
+    return out;
+}
+
+
+BloomFilter BloomFilter::deserialize(std::span<const std::uint8_t> bytes)
+{
+    check_serial_header(bytes, serial_magic, serial_version, "Bloom filter");
+
+    const std::uint64_t hashes = get_le(bytes.data() + 12, 4);
+    const std::uint64_t blocks = get_le(bytes.data() + 16, 8);
+    const size_t data_bytes = bytes.size() - serial_header_size;
+    if (blocks == 0 || data_bytes % (block_bits / 8) != 0 || blocks != data_bytes / (block_bits / 8))
+        throw std::invalid_argument("Bloom filter data does not match its header");
+
+    BloomFilter result(block_bits, static_cast<unsigned>(std::min<std::uint64_t>(hashes, max_hashes + 1)));
+    result.num_blocks = blocks;
+    result.bits = BitArray::from_bytes(bytes.subspan(serial_header_size), blocks * block_bits);
+    return result;
+}
+
+
+bool operator==(const BloomFilter& a, const BloomFilter& b)
+{
+    return a.num_hashes == b.num_hashes && a.bits == b.bits;
+}
+
+
+bool operator!=(const BloomFilter& a, const BloomFilter& b)
+{
+    return !(a == b);
+}
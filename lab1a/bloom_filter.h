@@ -0,0 +1,72 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include "bitarray.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Cache-line-blocked Bloom filter over 64-bit keys.
+// The bits live in a BitArray split into 512-bit blocks, each one cache
+// line (BitArray heap storage is 64-byte aligned). A key hashes to one block,
+// and all its probe bits are set within that block by double hashing,
+// h1 + i * h2. An insert or query therefore touches one cache line. The
+// probe bits are gathered into an eight-word mask, which the compiler turns
+// into a few vector compares.
+// Blocking raises the false-positive rate slightly above that of a classic
+// filter of the same size.
+class BloomFilter {
+public:
+    static constexpr size_t block_bits = 512;
+    static constexpr size_t block_words = block_bits / 64;
+    static constexpr unsigned max_hashes = 16;
+
+    struct Parameters {
+        size_t num_bits;
+        unsigned num_hashes;
+    };
+
+    // Size and hash count for expected_elements keys at the given false-positive rate
+    static Parameters optimal_parameters(size_t expected_elements, double false_positive_rate);
+
+private:
+    BitArray bits;  // num_blocks * block_bits bits
+    size_t num_blocks;
+    unsigned num_hashes;  // Probe bits per key, 1 to max_hashes
+
+    [[nodiscard]] size_t block_of(std::uint64_t hash) const;  // First word of the key's block
+    void block_mask(std::uint64_t hash, std::uint64_t (&mask)[block_words]) const;
+    void insert_hash(std::uint64_t hash);  // insert() and contains() after mixing the key
+    [[nodiscard]] bool contains_hash(std::uint64_t hash) const;
+
+public:
+    // num_bits is rounded up to whole blocks
+    BloomFilter(size_t num_bits, unsigned num_hashes);
+    static BloomFilter with_capacity(size_t expected_elements, double false_positive_rate);
+
+    void insert(std::uint64_t key);
+    [[nodiscard]] bool contains(std::uint64_t key) const;
+
+    // Batched versions that prefetch the blocks of upcoming keys; out[j] is
+    // set to contains(keys[j]) and must hold keys.size() bytes
+    void insert_many(std::span<const std::uint64_t> keys);
+    void contains_many(std::span<const std::uint64_t> keys, std::span<std::uint8_t> out) const;
+
+    void clear();
+
+    [[nodiscard]] size_t size() const;  // Bits in the filter
+    [[nodiscard]] unsigned hash_count() const;
+    [[nodiscard]] const BitArray& bit_array() const;
+
+    // Portable little-endian image: magic, version, hash count, block count, then the bits
+    [[nodiscard]] std::vector<std::uint8_t> serialize() const;
+    static BloomFilter deserialize(std::span<const std::uint8_t> bytes);
+
+    friend bool operator==(const BloomFilter& a, const BloomFilter& b);
+    friend bool operator!=(const BloomFilter& a, const BloomFilter& b);
+};
+
+bool operator==(const BloomFilter& a, const BloomFilter& b);
+bool operator!=(const BloomFilter& a, const BloomFilter& b);
+
+#endif // BLOOM_FILTER_H
@@ -0,0 +1,180 @@
+#include "cow_bitarray.h"
+#include "bitarray_kernels.h"
+#include <atomic>
+
+
+// Unshares p: a copy replaces it unless this is its only owner
+template <typename T>
+static T& unshare(std::shared_ptr<T>& p)
+{
+    if (p.use_count() != 1)
+        p = std::make_shared<T>(*p);
+    // Pairs with the release in the last other owner's decrement, so its reads finish before our writes
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return *p;
+}
+
+
+const std::shared_ptr<CowBitArray::Page>& CowBitArray::zero_page()
+{
+    static const std::shared_ptr<Page> page = std::make_shared<Page>();
+    return page;
+}
+
+
+const std::shared_ptr<CowBitArray::Leaf>& CowBitArray::zero_leaf()
+{
+    static const std::shared_ptr<Leaf> leaf = [] {
+        auto l = std::make_shared<Leaf>();
+        l->fill(zero_page());
+        return l;
+    }();
+    return leaf;
+}
+
+
+CowBitArray::CowBitArray() : CowBitArray(size_t(0)) {}
+
+
+CowBitArray::CowBitArray(size_t num_bits) : num_bits(num_bits)
+{
+    if (num_bits > BitArray::max_size())
+        throw std::invalid_argument("Size must be >=0");
+    root = std::make_shared<Root>((page_count() + leaf_pages - 1) / leaf_pages, zero_leaf());
+}
+
+
+CowBitArray::CowBitArray(const BitArray& b) : CowBitArray(b.size())
+{
+    // Only pages with a set bit get their own storage
+    for (size_t p = 0; p < page_count(); ++p) {
+        const size_t first = p * page_words;
+        const size_t n = std::min(page_words, b.word_count() - first);
+        if (std::any_of(b.data() + first, b.data() + first + n, [](unsigned long w) { return w != 0; })) {
+            std::copy(b.data() + first, b.data() + first + n, writable_page(p).begin());
+        }
+    }
+}
+
+
+CowBitArray CowBitArray::snapshot() const
+{
+    return *this;
+}
+
+
+size_t CowBitArray::page_count() const
+{
+    return (num_bits + page_bits - 1) / page_bits;
+}
+
+
+const CowBitArray::Page& CowBitArray::page(size_t p) const
+{
+    return *(*(*root)[p / leaf_pages])[p % leaf_pages];
+}
+
+
+CowBitArray::Page& CowBitArray::writable_page(size_t p)
+{
+    Leaf& leaf = unshare(unshare(root)[p / leaf_pages]);
+    return unshare(leaf[p % leaf_pages]);
+}
+
+
+void CowBitArray::check_index(size_t n) const
+{
+    if (n >= num_bits) throw std::out_of_range("Index out of bounds");
+}
+
+
+CowBitArray& CowBitArray::set(size_t n, bool val)
+{
+    // Writing a bit's current value would unshare a page for nothing
+    if (test(n) == val)
+        return *this;
+
+    unsigned long& word = writable_page(n / page_bits)[(n % page_bits) / 64];
+    word ^= 1UL << (n % 64);
+    return *this;
+}
+
+
+CowBitArray& CowBitArray::reset(size_t n)
+{
+    return set(n, false);
+}
+
+
+bool CowBitArray::test(size_t n) const
+{
+    check_index(n);
+    return (page(n / page_bits)[(n % page_bits) / 64] >> (n % 64)) & 1;
+}
+
+
+bool CowBitArray::operator[](size_t n) const
+{
+    return test(n);
+}
+
+
+size_t CowBitArray::count() const
+{
+    size_t total = 0;
+    for (const std::shared_ptr<Leaf>& leaf : *root) {
+        if (leaf == zero_leaf())
+            continue;
+        for (const std::shared_ptr<Page>& p : *leaf)
+            if (p != zero_page())
+                total += active_kernels().popcount(p->data(), page_words);
+    }
+    return total;
+}
+
+
+bool CowBitArray::any() const
+{
+    for (const std::shared_ptr<Leaf>& leaf : *root) {
+        if (leaf == zero_leaf())
+            continue;
+        for (const std::shared_ptr<Page>& p : *leaf)
+            if (p != zero_page() && std::any_of(p->begin(), p->end(), [](unsigned long w) { return w != 0; }))
+                return true;
+    }
+    return false;
+}
+
+
+bool CowBitArray::none() const
+{
+    return !any();
+}
+
+
+size_t CowBitArray::size() const
+{
+    return num_bits;
+}
+
+
+BitArray CowBitArray::to_bit_array() const
+{
+    BitArray result(num_bits);
+    unsigned long* out = result.data();
+    for (size_t p = 0; p < page_count(); ++p) {
+        const size_t first = p * page_words;
+        const Page& src = page(p);
+        std::copy(src.begin(), src.begin() + std::min(page_words, result.word_count() - first), out + first);
+    }
+    return result;
+}
+
+
+size_t CowBitArray::shared_pages(const CowBitArray& other) const
+{
+    size_t shared = 0;
+    for (size_t p = 0; p < std::min(page_count(), other.page_count()); ++p)
+        shared += &page(p) == &other.page(p);
+    return shared;
+}
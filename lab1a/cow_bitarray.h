@@ -0,0 +1,70 @@
+#ifndef COW_BITARRAY_H
+#define COW_BITARRAY_H
+
+#include "bitarray.h"
+#include <array>
+#include <memory>
+#include <vector>
+
+// Bit array with O(1) copy-on-write snapshots.
+// The bits are split into 4KB pages reached through a two-level table:
+// a root vector of leaves, each leaf holding 512 page pointers. Root,
+// leaves and pages are reference counted and shared between copies, so
+// copying (snapshot()) only copies the root pointer. The first write to a
+// shared page clones the root, the one leaf and the one page on its path;
+// later writes to that page are in place. Pages that were never written
+// all share one zero page, so a large, sparse array costs little memory.
+//
+// Each object must be used by one thread at a time, like a BitArray, but
+// snapshots can be handed to other threads and read while the original
+// keeps changing.
+class CowBitArray {
+public:
+    static constexpr size_t page_words = 512;
+    static constexpr size_t page_bits = page_words * 64;
+    static constexpr size_t leaf_pages = 512;
+
+private:
+    using Page = std::array<unsigned long, page_words>;
+    using Leaf = std::array<std::shared_ptr<Page>, leaf_pages>;
+    using Root = std::vector<std::shared_ptr<Leaf>>;
+
+    size_t num_bits;
+    std::shared_ptr<Root> root;
+
+    static const std::shared_ptr<Page>& zero_page();
+    static const std::shared_ptr<Leaf>& zero_leaf();
+
+    [[nodiscard]] size_t page_count() const;
+    [[nodiscard]] const Page& page(size_t p) const;
+    Page& writable_page(size_t p);  // Unshares the root, leaf and page on the path to page p
+    void check_index(size_t n) const;
+
+public:
+    CowBitArray();
+    explicit CowBitArray(size_t num_bits);
+    explicit CowBitArray(const BitArray& b);
+    // Copies share everything, so moving would gain nothing: moves copy too,
+    // which also keeps a moved-from array valid
+    CowBitArray(const CowBitArray& other) = default;
+    CowBitArray& operator=(const CowBitArray& other) = default;
+
+    [[nodiscard]] CowBitArray snapshot() const;  // Same as copying, O(1)
+
+    CowBitArray& set(size_t n, bool val = true);
+    CowBitArray& reset(size_t n);
+    [[nodiscard]] bool test(size_t n) const;
+    bool operator[](size_t n) const;
+
+    [[nodiscard]] size_t count() const;
+    [[nodiscard]] bool any() const;
+    [[nodiscard]] bool none() const;
+    [[nodiscard]] size_t size() const;
+
+    [[nodiscard]] BitArray to_bit_array() const;
+
+    // Number of pages this array and other point to in common
+    [[nodiscard]] size_t shared_pages(const CowBitArray& other) const;
+};
+
+#endif // COW_BITARRAY_H
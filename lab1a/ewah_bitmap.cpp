@@ -0,0 +1,411 @@
+#include "ewah_bitmap.h"
+#include "bitarray_kernels.h"
+#include "serial_io.h"
+
+static constexpr char serial_magic[8] = {'E', 'W', 'A', 'H', 'B', 'I', 'T', 'S'};
+static constexpr std::uint32_t serial_version = 1;
+
+static constexpr std::uint64_t max_run = 0xffffffffULL;  // 32 bits of run length
+static constexpr std::uint64_t max_literals = (std::uint64_t(1) << 31) - 1;  // 31 bits of literal count
+
+
+static std::uint64_t make_marker(bool bit, std::uint64_t run, std::uint64_t literals)
+{
+    return std::uint64_t(bit) | (run << 1) | (literals << 33);
+}
+
+
+static bool marker_bit(std::uint64_t marker)
+{
+    return marker & 1;
+}
+
+
+static std::uint64_t marker_run(std::uint64_t marker)
+{
+    return (marker >> 1) & max_run;
+}
+
+
+static std::uint64_t marker_literals(std::uint64_t marker)
+{
+    return marker >> 33;
+}
+
+
+// Moves the next count words of in to out, runs as runs
+static void copy_words(EwahReader& in, std::uint64_t count, EwahWriter& out)
+{
+    while (count > 0) {
+        if (in.done()) throw std::invalid_argument("Stream lengths must be equal");
+        std::uint64_t n;
+        if (in.run_words() != 0) {
+            n = std::min(count, in.run_words());
+            out.add_run(in.run_bit(), n);
+        } else {
+            n = std::min<std::uint64_t>(count, in.literals().size());
+            out.add_words(in.literals().first(n));
+        }
+        in.skip(n);
+        count -= n;
+    }
+}
+
+
+// Drops the next count words of in, a group at a time
+static void skip_words(EwahReader& in, std::uint64_t count)
+{
+    while (count > 0) {
+        if (in.done()) throw std::invalid_argument("Stream lengths must be equal");
+        const std::uint64_t n = std::min<std::uint64_t>(count, in.run_words() + in.literals().size());
+        in.skip(n);
+        count -= n;
+    }
+}
+
+
+EwahWriter::EwahWriter() : buffer{0}, marker(0), words_added(0), last_word(0), discarded(false) {}
+
+
+void EwahWriter::start_group(bool bit, std::uint64_t run, std::uint64_t literals)
+{
+    marker = buffer.size();
+    buffer.push_back(make_marker(bit, run, literals));
+}
+
+
+void EwahWriter::add_word(std::uint64_t word)
+{
+    if (word == 0 || word == ~std::uint64_t(0)) {
+        add_run(word != 0, 1);
+        return;
+    }
+
+    ++words_added;
+    last_word = word;
+    if (marker_literals(buffer[marker]) < max_literals)
+        buffer[marker] += std::uint64_t(1) << 33;
+    else
+        start_group(false, 0, 1);
+    buffer.push_back(word);
+}
+
+
+void EwahWriter::add_words(std::span<const std::uint64_t> words)
+{
+    for (std::uint64_t word : words)
+        add_word(word);
+}
+
+
+void EwahWriter::add_run(bool bit, size_t count)
+{
+    if (count == 0)
+        return;
+
+    words_added += count;
+    last_word = bit ? ~std::uint64_t(0) : 0;
+    while (count > 0) {
+        // The open group can take the run if it has no literals yet and an
+        // empty or matching run that is not full
+        const std::uint64_t m = buffer[marker];
+        const std::uint64_t run = marker_run(m);
+        if (marker_literals(m) == 0 && (run == 0 || marker_bit(m) == bit) && run < max_run) {
+            const std::uint64_t n = std::min<std::uint64_t>(count, max_run - run);
+            buffer[marker] = make_marker(bit, run + n, 0);
+            count -= n;
+        } else {
+            start_group(bit, 0, 0);
+        }
+    }
+}
+
+
+size_t EwahWriter::word_count() const
+{
+    return words_added;
+}
+
+
+std::span<const std::uint64_t> EwahWriter::stream() const
+{
+    return buffer;
+}
+
+
+std::span<const std::uint64_t> EwahWriter::completed() const
+{
+    return std::span<const std::uint64_t>(buffer).first(marker);
+}
+
+
+void EwahWriter::discard_completed()
+{
+    if (marker == 0)
+        return;
+    buffer.erase(buffer.begin(), buffer.begin() + marker);
+    marker = 0;
+    discarded = true;
+}
+
+
+EwahBitmap EwahWriter::finish(size_t num_bits)
+{
+    if (discarded) throw std::logic_error("Part of the stream was discarded");
+    if (num_bits > BitArray::max_size() || words_added != (num_bits + 63) / 64)
+        throw std::invalid_argument("Stream length does not match the size");
+    if (words_added != 0 && (last_word & ~last_word_mask(num_bits)) != 0)
+        throw std::invalid_argument("Bits past the size must be zero");
+
+    EwahBitmap result(num_bits, std::move(buffer));
+    buffer = {0};
+    marker = 0;
+    words_added = 0;
+    last_word = 0;
+    return result;
+}
+
+
+EwahReader::EwahReader(std::span<const std::uint64_t> stream)
+    : stream(stream), next_marker(0), fill(false), run_left(0), literal_pos(0), literals_left(0)
+{
+    load_group();
+}
+
+
+void EwahReader::load_group()
+{
+    while (run_left == 0 && literals_left == 0 && next_marker < stream.size()) {
+        const std::uint64_t m = stream[next_marker];
+        fill = marker_bit(m);
+        run_left = marker_run(m);
+        literal_pos = next_marker + 1;
+        if (marker_literals(m) > stream.size() - literal_pos)
+            throw std::invalid_argument("Corrupt EWAH stream");
+        literals_left = marker_literals(m);
+        next_marker = literal_pos + literals_left;
+    }
+}
+
+
+bool EwahReader::done() const
+{
+    return run_left == 0 && literals_left == 0;
+}
+
+
+bool EwahReader::run_bit() const
+{
+    return fill;
+}
+
+
+std::uint64_t EwahReader::run_words() const
+{
+    return run_left;
+}
+
+
+std::span<const std::uint64_t> EwahReader::literals() const
+{
+    return stream.subspan(literal_pos, literals_left);
+}
+
+
+void EwahReader::skip(std::uint64_t words)
+{
+    while (words > 0) {
+        if (done()) throw std::out_of_range("Range out of bounds");
+        const std::uint64_t from_run = std::min(words, run_left);
+        run_left -= from_run;
+        words -= from_run;
+        const std::uint64_t from_literals = std::min<std::uint64_t>(words, literals_left);
+        literal_pos += from_literals;
+        literals_left -= from_literals;
+        words -= from_literals;
+        load_group();
+    }
+}
+
+
+size_t EwahReader::read(std::span<std::uint64_t> out)
+{
+    size_t n = 0;
+    while (n < out.size() && !done()) {
+        size_t k;
+        if (run_left != 0) {
+            k = std::min<std::uint64_t>(run_left, out.size() - n);
+            std::fill_n(out.begin() + n, k, fill ? ~std::uint64_t(0) : 0);
+        } else {
+            k = std::min(literals_left, out.size() - n);
+            std::copy_n(stream.begin() + literal_pos, k, out.begin() + n);
+        }
+        n += k;
+        skip(k);
+    }
+    return n;
+}
+
+
+EwahBitmap::EwahBitmap(size_t num_bits, std::vector<std::uint64_t> words) : num_bits(num_bits), words(std::move(words)) {}
+
+
+EwahBitmap::EwahBitmap() : num_bits(0), words{0} {}
+
+
+EwahBitmap::EwahBitmap(const BitArray& b) : EwahBitmap()
+{
+    EwahWriter writer;
+    writer.add_words(std::span<const std::uint64_t>(b.data(), b.word_count()));
+    *this = writer.finish(b.size());
+}
+
+
+BitArray EwahBitmap::to_bit_array() const
+{
+    BitArray result(num_bits);
+    reader().read(std::span<std::uint64_t>(result.data(), result.word_count()));
+    return result;
+}
+
+
+EwahReader EwahBitmap::reader() const
+{
+    return EwahReader(words);
+}
+
+
+size_t EwahBitmap::size() const
+{
+    return num_bits;
+}
+
+
+size_t EwahBitmap::count() const
+{
+    size_t total = 0;
+    for (size_t pos = 0; pos < words.size(); pos += 1 + marker_literals(words[pos])) {
+        if (marker_bit(words[pos]))
+            total += 64 * marker_run(words[pos]);
+        total += active_kernels().popcount(words.data() + pos + 1, marker_literals(words[pos]));
+    }
+    return total;
+}
+
+
+std::span<const std::uint64_t> EwahBitmap::compressed() const
+{
+    return words;
+}
+
+
+std::vector<std::uint8_t> EwahBitmap::serialize() const
+{
+    std::vector<std::uint8_t> out = start_serial_header(serial_magic, serial_version);
+    put_le(out, 0, 4);  // Reserved
+    put_le(out, num_bits, 8);
+    out.reserve(serial_header_size + 8 * words.size());
+    for (std::uint64_t word : words)
+        put_le(out, word, 8);
+    return out;
+}
+
+
+EwahBitmap EwahBitmap::deserialize(std::span<const std::uint8_t> bytes)
+{
+    check_serial_header(bytes, serial_magic, serial_version, "EWAH bitmap");
+    if ((bytes.size() - serial_header_size) % 8 != 0)
+        throw std::invalid_argument("EWAH data does not match its header");
+
+    std::vector<std::uint64_t> stream((bytes.size() - serial_header_size) / 8);
+    for (size_t i = 0; i < stream.size(); ++i)
+        stream[i] = get_le(bytes.data() + serial_header_size + 8 * i, 8);
+
+    // Re-encoding checks the stream against the size and makes it canonical
+    // without expanding its runs
+    EwahReader in(stream);
+    EwahWriter out;
+    while (!in.done())
+        copy_words(in, in.run_words() + in.literals().size(), out);
+    return out.finish(get_le(bytes.data() + 16, 8));
+}
+
+
+template <bool IsAnd>
+void EwahBitmap::merge(EwahReader& a, EwahReader& b, EwahWriter& out)
+{
+    // Zeros decide an AND, ones decide an OR
+    constexpr bool absorbing = !IsAnd;
+    while (!a.done() && !b.done()) {
+        if (a.run_words() == 0 && b.run_words() == 0) {
+            const std::span<const std::uint64_t> la = a.literals(), lb = b.literals();
+            const size_t n = std::min(la.size(), lb.size());
+            for (size_t i = 0; i < n; ++i)
+                out.add_word(IsAnd ? la[i] & lb[i] : la[i] | lb[i]);
+            a.skip(n);
+            b.skip(n);
+            continue;
+        }
+
+        // The longer run covers words of the other operand, whatever they hold
+        EwahReader& run = a.run_words() >= b.run_words() ? a : b;
+        EwahReader& other = &run == &a ? b : a;
+        const std::uint64_t n = run.run_words();
+        if (run.run_bit() == absorbing) {
+            out.add_run(absorbing, n);
+            skip_words(other, n);
+        } else {
+            copy_words(other, n, out);
+        }
+        run.skip(n);
+    }
+    if (!a.done() || !b.done()) throw std::invalid_argument("Stream lengths must be equal");
+}
+
+
+template <bool IsAnd>
+EwahBitmap EwahBitmap::merge(const EwahBitmap& a, const EwahBitmap& b)
+{
+    if (a.num_bits != b.num_bits) throw std::invalid_argument("Sizes must be equal");
+
+    EwahReader x = a.reader(), y = b.reader();
+    EwahWriter out;
+    merge<IsAnd>(x, y, out);
+    return out.finish(a.num_bits);
+}
+
+
+void EwahBitmap::merge_and(EwahReader& a, EwahReader& b, EwahWriter& out)
+{
+    merge<true>(a, b, out);
+}
+
+
+void EwahBitmap::merge_or(EwahReader& a, EwahReader& b, EwahWriter& out)
+{
+    merge<false>(a, b, out);
+}
+
+
+EwahBitmap operator&(const EwahBitmap& a, const EwahBitmap& b)
+{
+    return EwahBitmap::merge<true>(a, b);
+}
+
+
+EwahBitmap operator|(const EwahBitmap& a, const EwahBitmap& b)
+{
+    return EwahBitmap::merge<false>(a, b);
+}
+
+
+bool operator==(const EwahBitmap& a, const EwahBitmap& b)
+{
+    return a.num_bits == b.num_bits && a.words == b.words;
+}
+
+
+bool operator!=(const EwahBitmap& a, const EwahBitmap& b)
+{
+    return !(a == b);
+}
@@ -0,0 +1,134 @@
+#ifndef EWAH_BITMAP_H
+#define EWAH_BITMAP_H
+
+#include "bitarray.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class EwahBitmap;
+
+// Enhanced word-aligned hybrid (EWAH) compression of BitArray words.
+// The compressed stream is a sequence of groups, each a marker word
+// followed by literal words:
+//  - bit 0 of the marker:       value of the clean words of the run
+//  - bits 1..32 of the marker:  number of clean (all 0 or all 1) words in the run
+//  - bits 33..63 of the marker: number of literal words copied after the run
+// Runs of empty or full words cost one marker, so mostly-empty and
+// mostly-full arrays shrink to a few words, while the worst case adds one
+// marker per 2^31 - 1 literal words.
+
+// Streaming encoder: uncompressed words go in one at a time, in bulk or as
+// runs, and the compressed stream grows behind them. Everything before the
+// current marker is final, so long streams can be written out piecewise
+// with completed() and discard_completed().
+class EwahWriter {
+private:
+    std::vector<std::uint64_t> buffer;  // Compressed words; buffer[marker] is the open marker
+    size_t marker;
+    size_t words_added;  // Uncompressed words so far
+    std::uint64_t last_word;  // Last uncompressed word, for the tail check in finish()
+    bool discarded;  // Part of the stream was dropped, so finish() is unavailable
+
+    void start_group(bool bit, std::uint64_t run, std::uint64_t literals);
+
+public:
+    EwahWriter();
+
+    void add_word(std::uint64_t word);
+    void add_words(std::span<const std::uint64_t> words);
+    void add_run(bool bit, size_t count);  // count words of all zeros or all ones
+
+    [[nodiscard]] size_t word_count() const;  // Uncompressed words added
+    [[nodiscard]] std::span<const std::uint64_t> stream() const;  // The whole stream, valid at any point
+    [[nodiscard]] std::span<const std::uint64_t> completed() const;  // The words that will not change
+    void discard_completed();
+
+    // Takes the stream as a bitmap of num_bits bits; the words added must be
+    // exactly the words of num_bits bits, with the bits past num_bits zero
+    [[nodiscard]] EwahBitmap finish(size_t num_bits);
+};
+
+
+// Streaming decoder over a compressed stream. read() produces the
+// uncompressed words a chunk at a time; run_words(), literals() and skip()
+// walk the stream group by group without expanding runs.
+class EwahReader {
+private:
+    std::span<const std::uint64_t> stream;
+    size_t next_marker;  // Position of the next group
+    bool fill;  // Value of the current run
+    std::uint64_t run_left;  // Clean words left in the current run
+    size_t literal_pos;  // Position of the next literal word
+    size_t literals_left;  // Literal words left after the run
+
+    void load_group();  // Moves to the next non-empty group once the current one is used up
+
+public:
+    // A group whose literals run past the end of the stream throws invalid_argument
+    explicit EwahReader(std::span<const std::uint64_t> stream);
+
+    [[nodiscard]] bool done() const;
+    [[nodiscard]] bool run_bit() const;
+    [[nodiscard]] std::uint64_t run_words() const;  // Clean words before literals()
+    [[nodiscard]] std::span<const std::uint64_t> literals() const;  // Literal words after the run
+    void skip(std::uint64_t words);  // Consumes words of the run first, then literals, across groups
+
+    // Fills out with the next uncompressed words; returns how many, 0 once done
+    size_t read(std::span<std::uint64_t> out);
+};
+
+
+// A BitArray kept EWAH-compressed. & and | merge two compressed streams
+// group by group: a run that decides the result (zeros for &, ones for |)
+// skips the matching words of the other operand, and the other kind of run
+// copies them, so only overlapping literal words are combined one by one.
+// Streams are kept canonical (no clean literals, adjacent runs merged), so
+// equal bitmaps have equal streams.
+class EwahBitmap {
+private:
+    size_t num_bits;
+    std::vector<std::uint64_t> words;  // Compressed stream
+
+    friend class EwahWriter;
+    EwahBitmap(size_t num_bits, std::vector<std::uint64_t> words);
+
+    template <bool IsAnd>
+    static void merge(EwahReader& a, EwahReader& b, EwahWriter& out);
+    template <bool IsAnd>
+    static EwahBitmap merge(const EwahBitmap& a, const EwahBitmap& b);
+
+public:
+    EwahBitmap();
+    explicit EwahBitmap(const BitArray& b);
+
+    [[nodiscard]] BitArray to_bit_array() const;
+    [[nodiscard]] EwahReader reader() const;
+
+    [[nodiscard]] size_t size() const;  // Bits
+    [[nodiscard]] size_t count() const;  // Set bits, from the runs and literals without decoding
+    [[nodiscard]] std::span<const std::uint64_t> compressed() const;
+
+    // Portable little-endian image: magic, version, size in bits, then the stream
+    [[nodiscard]] std::vector<std::uint8_t> serialize() const;
+    static EwahBitmap deserialize(std::span<const std::uint8_t> bytes);
+
+    // Streaming & and |: merge what is left of a and b into out. The readers
+    // must have the same number of words left, else invalid_argument is thrown.
+    // Nothing is decoded or copied up front, so streams mapped from disk merge
+    // with out drained through completed() and discard_completed() as it grows.
+    static void merge_and(EwahReader& a, EwahReader& b, EwahWriter& out);
+    static void merge_or(EwahReader& a, EwahReader& b, EwahWriter& out);
+
+    friend EwahBitmap operator&(const EwahBitmap& a, const EwahBitmap& b);
+    friend EwahBitmap operator|(const EwahBitmap& a, const EwahBitmap& b);
+    friend bool operator==(const EwahBitmap& a, const EwahBitmap& b);
+    friend bool operator!=(const EwahBitmap& a, const EwahBitmap& b);
+};
+
+EwahBitmap operator&(const EwahBitmap& a, const EwahBitmap& b);
+EwahBitmap operator|(const EwahBitmap& a, const EwahBitmap& b);
+bool operator==(const EwahBitmap& a, const EwahBitmap& b);
+bool operator!=(const EwahBitmap& a, const EwahBitmap& b);
+
+#endif // EWAH_BITMAP_H
@@ -0,0 +1,451 @@
+#ifndef FIXED_BITARRAY_H
+#define FIXED_BITARRAY_H
+
+#include "bitarray.h"
+#include <array>
+#include <bit>
+#include <utility>
+
+// BitArray with the width fixed at compile time. The words live inside the
+// object, every operation but the BitArray conversions is constexpr, and
+// binary operators only accept arrays of the same N, so size mismatches are
+// compile errors rather than exceptions. Word-wise operations expand into one
+// statement per word. Calls that change the size (resize, push_back, ...)
+// have no counterpart. Bits past N in the last word are always kept zero.
+template <size_t N>
+class FixedBitArray {
+private:
+    static constexpr size_t num_words = (N + 63) / 64;
+    static constexpr unsigned long last_mask = N % 64 == 0 ? ~0UL : (1UL << (N % 64)) - 1;
+
+    std::array<unsigned long, num_words> data{};  // Storage for the bits
+
+    // Calls f(i) for every word index, unrolled
+    template <typename F>
+    static constexpr void for_each_word(F f)
+    {
+        [&]<size_t... I>(std::index_sequence<I...>) { (f(I), ...); }(std::make_index_sequence<num_words>{});
+    }
+
+    constexpr void clear_unused_bits()
+    {
+        if constexpr (num_words != 0)
+            data[num_words - 1] &= last_mask;
+    }
+
+    static constexpr void check_index(size_t n)
+    {
+        if (n >= N) throw std::out_of_range("Index out of bounds");
+    }
+
+    static constexpr void check_range(size_t first, size_t last)
+    {
+        if (first > last || last > N) throw std::out_of_range("Range out of bounds");
+    }
+
+    // Bits of word i that fall in [first, last)
+    static constexpr unsigned long range_mask(size_t i, size_t first, size_t last)
+    {
+        const size_t lo = std::max(first, 64 * i), hi = std::min(last, 64 * i + 64);
+        if (lo >= hi)
+            return 0;
+        return (~0UL << (lo - 64 * i)) & last_word_mask(hi);
+    }
+
+public:
+    constexpr FixedBitArray() = default;
+
+    constexpr explicit FixedBitArray(unsigned long value)
+    {
+        if constexpr (num_words != 0) {
+            data[0] = value;
+            clear_unused_bits();
+        }
+    }
+
+    explicit FixedBitArray(const BitArray& b)
+    {
+        if (b.size() != N) throw std::invalid_argument("Sizes must be equal");
+        for_each_word([&](size_t i) { data[i] = b.word(i); });
+        clear_unused_bits();
+    }
+
+    [[nodiscard]] BitArray to_bit_array() const
+    {
+        BitArray result(N);
+        unsigned long* out = result.data();
+        for_each_word([&](size_t i) { out[i] = data[i]; });
+        return result;
+    }
+
+    [[nodiscard]] static constexpr size_t size() { return N; }
+    [[nodiscard]] static constexpr bool empty() { return N == 0; }
+
+    // Word access, matching BitArray's
+    [[nodiscard]] static constexpr size_t word_count() { return num_words; }
+    [[nodiscard]] constexpr unsigned long word(size_t i) const { return data[i]; }
+
+    constexpr bool operator[](size_t i) const
+    {
+        check_index(i);
+        return (data[i / 64] >> (i % 64)) & 1;
+    }
+
+    constexpr FixedBitArray& set(size_t n, bool val = true)
+    {
+        check_index(n);
+        if (val)
+            data[n / 64] |= (1UL << (n % 64));
+        else
+            data[n / 64] &= ~(1UL << (n % 64));
+        return *this;
+    }
+
+    constexpr FixedBitArray& set()
+    {
+        for_each_word([&](size_t i) { data[i] = ~0UL; });
+        clear_unused_bits();
+        return *this;
+    }
+
+    constexpr FixedBitArray& reset(size_t n) { return set(n, false); }
+
+    constexpr FixedBitArray& reset()
+    {
+        for_each_word([&](size_t i) { data[i] = 0; });
+        return *this;
+    }
+
+    constexpr FixedBitArray& flip(size_t n)
+    {
+        check_index(n);
+        data[n / 64] ^= 1UL << (n % 64);
+        return *this;
+    }
+
+    constexpr FixedBitArray& flip()
+    {
+        for_each_word([&](size_t i) { data[i] = ~data[i]; });
+        clear_unused_bits();
+        return *this;
+    }
+
+    // The same over the bits in [first, last), first <= last <= N
+    constexpr FixedBitArray& set_range(size_t first, size_t last, bool val = true)
+    {
+        check_range(first, last);
+        for_each_word([&](size_t i) {
+            const unsigned long mask = range_mask(i, first, last);
+            data[i] = val ? data[i] | mask : data[i] & ~mask;
+        });
+        return *this;
+    }
+
+    constexpr FixedBitArray& reset_range(size_t first, size_t last) { return set_range(first, last, false); }
+
+    constexpr FixedBitArray& flip_range(size_t first, size_t last)
+    {
+        check_range(first, last);
+        for_each_word([&](size_t i) { data[i] ^= range_mask(i, first, last); });
+        return *this;
+    }
+
+    [[nodiscard]] constexpr size_t count_range(size_t first, size_t last) const
+    {
+        check_range(first, last);
+        size_t total = 0;
+        for_each_word([&](size_t i) { total += std::popcount(data[i] & range_mask(i, first, last)); });
+        return total;
+    }
+
+    [[nodiscard]] constexpr size_t count() const
+    {
+        size_t total = 0;
+        for_each_word([&](size_t i) { total += std::popcount(data[i]); });
+        return total;
+    }
+
+    [[nodiscard]] constexpr bool any() const
+    {
+        unsigned long combined = 0;
+        for_each_word([&](size_t i) { combined |= data[i]; });
+        return combined != 0;
+    }
+
+    [[nodiscard]] constexpr bool none() const { return !any(); }
+
+    constexpr FixedBitArray& operator&=(const FixedBitArray& b)
+    {
+        for_each_word([&](size_t i) { data[i] &= b.data[i]; });
+        return *this;
+    }
+
+    constexpr FixedBitArray& operator|=(const FixedBitArray& b)
+    {
+        for_each_word([&](size_t i) { data[i] |= b.data[i]; });
+        return *this;
+    }
+
+    constexpr FixedBitArray& operator^=(const FixedBitArray& b)
+    {
+        for_each_word([&](size_t i) { data[i] ^= b.data[i]; });
+        return *this;
+    }
+
+    constexpr FixedBitArray operator~() const
+    {
+        FixedBitArray result;
+        for_each_word([&](size_t i) { result.data[i] = ~data[i]; });
+        result.clear_unused_bits();
+        return result;
+    }
+
+    constexpr FixedBitArray& operator<<=(size_t n)
+    {
+        if (n > BitArray::max_size()) throw std::invalid_argument("Shift must be >=0");
+        if (n >= N)
+            return reset();
+
+        const size_t word_shift = n / 64;
+        const unsigned bit_shift = n % 64;
+        for (size_t j = num_words; j-- > word_shift;) {
+            size_t src = j - word_shift;
+            unsigned long word = data[src] << bit_shift;
+            if (bit_shift != 0 && src > 0)
+                word |= data[src - 1] >> (64 - bit_shift);
+            data[j] = word;
+        }
+        for (size_t j = 0; j < word_shift; ++j)
+            data[j] = 0;
+        clear_unused_bits();
+        return *this;
+    }
+
+    constexpr FixedBitArray& operator>>=(size_t n)
+    {
+        if (n > BitArray::max_size()) throw std::invalid_argument("Shift must be >=0");
+        if (n >= N)
+            return reset();
+
+        const size_t word_shift = n / 64;
+        const unsigned bit_shift = n % 64;
+        const size_t kept = num_words - word_shift;
+        for (size_t j = 0; j < kept; ++j) {
+            size_t src = j + word_shift;
+            unsigned long word = data[src] >> bit_shift;
+            if (bit_shift != 0 && src + 1 < num_words)
+                word |= data[src + 1] << (64 - bit_shift);
+            data[j] = word;
+        }
+        for (size_t j = kept; j < num_words; ++j)
+            data[j] = 0;
+        return *this;
+    }
+
+    constexpr FixedBitArray& rotate_left(size_t n)
+    {
+        if (n > BitArray::max_size()) throw std::invalid_argument("Shift must be >=0");
+        if (N == 0 || n % N == 0)
+            return *this;
+
+        n %= N;
+        FixedBitArray wrapped = *this >> (N - n);
+        *this <<= n;
+        return *this |= wrapped;
+    }
+
+    constexpr FixedBitArray& rotate_right(size_t n)
+    {
+        if (n > BitArray::max_size()) throw std::invalid_argument("Shift must be >=0");
+        if (N == 0)
+            return *this;
+        return rotate_left(N - n % N);
+    }
+
+    constexpr FixedBitArray operator<<(size_t n) const
+    {
+        FixedBitArray result(*this);
+        result <<= n;
+        return result;
+    }
+
+    constexpr FixedBitArray operator>>(size_t n) const
+    {
+        FixedBitArray result(*this);
+        result >>= n;
+        return result;
+    }
+
+    // Set-bit search; BitArray::npos when there is none
+    [[nodiscard]] constexpr size_t find_first() const
+    {
+        for (size_t i = 0; i < num_words; ++i)
+            if (data[i] != 0)
+                return i * 64 + std::countr_zero(data[i]);
+        return BitArray::npos;
+    }
+
+    constexpr size_t find_next(size_t i) const  // First set bit after position i
+    {
+        check_index(i);
+        if (i + 1 == N)
+            return BitArray::npos;
+
+        size_t w = (i + 1) / 64;
+        unsigned long word = data[w] & (~0UL << ((i + 1) % 64));
+        while (word == 0) {
+            if (++w == num_words)
+                return BitArray::npos;
+            word = data[w];
+        }
+        return w * 64 + std::countr_zero(word);
+    }
+
+    [[nodiscard]] constexpr size_t find_last() const
+    {
+        for (size_t i = num_words; i-- > 0;)
+            if (data[i] != 0)
+                return i * 64 + 63 - std::countl_zero(data[i]);
+        return BitArray::npos;
+    }
+
+    // Iterator over every bit, like BitArray::Iterator
+    class Iterator {
+    private:
+        const FixedBitArray* bit_array;
+        size_t index;
+
+    public:
+        constexpr Iterator(const FixedBitArray* ba, size_t idx) : bit_array(ba), index(idx) {}
+        constexpr bool operator*() const { return (bit_array->data[index / 64] >> (index % 64)) & 1; }
+        constexpr Iterator& operator++()
+        {
+            ++index;
+            return *this;
+        }
+        constexpr bool operator==(const Iterator& other) const = default;
+    };
+
+    constexpr Iterator begin() const { return Iterator(this, 0); }
+    constexpr Iterator end() const { return Iterator(this, N); }
+
+    // Iterator over the indices of the set bits, in increasing order
+    class SetBitIterator {
+    private:
+        const FixedBitArray* bit_array;
+        size_t word_index;  // Word being scanned, word_count() at the end
+        unsigned long remaining;  // Bits of that word not visited yet
+
+        constexpr void skip_empty_words()
+        {
+            while (remaining == 0 && ++word_index < num_words)
+                remaining = bit_array->data[word_index];
+            if (remaining == 0)
+                word_index = num_words;
+        }
+
+    public:
+        constexpr SetBitIterator(const FixedBitArray* ba, size_t word_idx) : bit_array(ba), word_index(word_idx), remaining(0)
+        {
+            if (word_index < num_words) {
+                remaining = bit_array->data[word_index];
+                skip_empty_words();
+            }
+        }
+
+        constexpr size_t operator*() const { return word_index * 64 + std::countr_zero(remaining); }
+
+        constexpr SetBitIterator& operator++()
+        {
+            remaining &= remaining - 1;
+            skip_empty_words();
+            return *this;
+        }
+
+        constexpr bool operator==(const SetBitIterator& other) const
+        {
+            return word_index == other.word_index && remaining == other.remaining;
+        }
+    };
+
+    struct SetBitRange {
+        const FixedBitArray* bit_array;
+        constexpr SetBitIterator begin() const { return SetBitIterator(bit_array, 0); }
+        constexpr SetBitIterator end() const { return SetBitIterator(bit_array, num_words); }
+    };
+
+    // for (size_t i : fixed.set_bits()) visits every set bit
+    [[nodiscard]] constexpr SetBitRange set_bits() const { return SetBitRange{this}; }
+
+    [[nodiscard]] constexpr std::string to_string() const
+    {
+        std::string result(N, '0');
+        for (size_t i = 0; i < N; ++i)
+            if ((data[i / 64] >> (i % 64)) & 1)
+                result[N - 1 - i] = '1';
+        return result;
+    }
+
+    // Lowercase, most significant digit first, like BitArray::to_hex()
+    [[nodiscard]] constexpr std::string to_hex() const
+    {
+        constexpr size_t digits = (N + 3) / 4;
+        std::string result(digits, '0');
+        for (size_t n = 0; n < digits; ++n)  // n counts digits from the least significant
+            result[digits - 1 - n] = "0123456789abcdef"[(data[n / 16] >> (4 * (n % 16))) & 0xf];
+        return result;
+    }
+
+    // Exactly (N + 3) / 4 digits, either case; malformed input throws std::invalid_argument
+    static constexpr FixedBitArray from_hex(std::string_view hex)
+    {
+        constexpr size_t digits = (N + 3) / 4;
+        if (hex.size() != digits)
+            throw std::invalid_argument("Size does not match the number of digits");
+
+        FixedBitArray result;
+        for (size_t n = 0; n < digits; ++n) {
+            const char c = hex[digits - 1 - n];
+            unsigned long value;
+            if (c >= '0' && c <= '9')
+                value = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                value = c - 'A' + 10;
+            else
+                throw std::invalid_argument("Invalid hex digit");
+            result.data[n / 16] |= value << (4 * (n % 16));
+        }
+        if constexpr (num_words != 0)
+            if ((result.data[num_words - 1] & ~last_mask) != 0)
+                throw std::invalid_argument("Digits do not fit in the size");
+        return result;
+    }
+
+    // Equal to to_bit_array().hash()
+    [[nodiscard]] constexpr size_t hash() const noexcept { return hash_bit_words(data.data(), num_words, N); }
+
+    friend constexpr bool operator==(const FixedBitArray& a, const FixedBitArray& b) = default;
+
+    // Lexicographic by bit index, like BitArray: the lowest differing bit decides
+    friend constexpr std::strong_ordering operator<=>(const FixedBitArray& a, const FixedBitArray& b)
+    {
+        for (size_t i = 0; i < num_words; ++i)
+            if (const unsigned long diff = a.data[i] ^ b.data[i]; diff != 0)
+                return (a.data[i] >> std::countr_zero(diff)) & 1 ? std::strong_ordering::greater
+                                                                  : std::strong_ordering::less;
+        return std::strong_ordering::equal;
+    }
+
+    friend constexpr FixedBitArray operator&(FixedBitArray a, const FixedBitArray& b) { return a &= b; }
+    friend constexpr FixedBitArray operator|(FixedBitArray a, const FixedBitArray& b) { return a |= b; }
+    friend constexpr FixedBitArray operator^(FixedBitArray a, const FixedBitArray& b) { return a ^= b; }
+};
+
+template <size_t N>
+struct std::hash<FixedBitArray<N>> {
+    constexpr size_t operator()(const FixedBitArray<N>& b) const noexcept { return b.hash(); }
+};
+
+#endif // FIXED_BITARRAY_H
@@ -0,0 +1,18 @@
+#ifndef HASH_MIX_H
+#define HASH_MIX_H
+
+#include <cstdint>
+
+// Murmur3 finalizer: spreads every input bit over the whole hash. Shared by
+// BloomFilter (key hashing) and MappedBitArray (the data checksum).
+constexpr std::uint64_t murmur_mix(std::uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+#endif // HASH_MIX_H
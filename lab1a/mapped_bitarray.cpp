@@ -0,0 +1,377 @@
+#include "mapped_bitarray.h"
+#include "hash_mix.h"
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char file_magic[8] = {'B', 'I', 'T', 'A', 'R', 'R', 'A', 'Y'};
+
+
+// Contribution of word i to the data checksum. Zero words contribute
+// nothing, so a fresh file's checksum needs no pass over its data.
+static std::uint64_t word_hash(size_t i, std::uint64_t word)
+{
+    return word == 0 ? 0 : murmur_mix(word ^ (i * 0x9E3779B97F4A7C15ULL));
+}
+
+
+static std::uint64_t empty_checksum(std::uint64_t num_bits)
+{
+    return murmur_mix(num_bits + 1);
+}
+
+
+static std::uint64_t header_checksum(const MappedBitArrayHeader& header)
+{
+    const auto* bytes = reinterpret_cast<const unsigned char*>(&header);
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < offsetof(MappedBitArrayHeader, header_checksum); ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+
+static size_t file_bytes(std::uint64_t num_bits)
+{
+    return sizeof(MappedBitArrayHeader) + (num_bits + 63) / 64 * sizeof(std::uint64_t);
+}
+
+
+[[noreturn]] static void throw_errno(const std::string& what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+
+MappedBitArray::MappedBitArray(int fd, Mode mode, size_t mapped_bytes, void* mapping)
+    : fd(fd), mode(mode), mapped_bytes(mapped_bytes),
+      header(static_cast<MappedBitArrayHeader*>(mapping)),
+      words(reinterpret_cast<std::uint64_t*>(static_cast<char*>(mapping) + sizeof(MappedBitArrayHeader))),
+      checksum(header->data_checksum), dirty(false)
+{}
+
+
+MappedBitArray MappedBitArray::create(const std::string& path, size_t num_bits)
+{
+    if (num_bits > BitArray::max_size())
+        throw std::invalid_argument("Size must be >=0");
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw_errno("Cannot create " + path);
+
+    // ftruncate zero-fills lazily, so creating a huge array costs no I/O
+    size_t bytes = file_bytes(num_bits);
+    if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        throw_errno("Cannot resize " + path);
+    }
+    void* mapping = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        throw_errno("Cannot map " + path);
+    }
+
+    MappedBitArray result(fd, Mode::read_write, bytes, mapping);
+    MappedBitArrayHeader& header = *result.header;
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version = format_version;
+    header.word_size = sizeof(std::uint64_t);
+    header.endianness = endianness_marker;
+    header.header_size = sizeof(MappedBitArrayHeader);
+    header.num_bits = num_bits;
+    header.flags = 0;
+    result.checksum = empty_checksum(num_bits);
+    result.write_header();
+    return result;
+}
+
+
+MappedBitArray MappedBitArray::create(const std::string& path, const BitArray& b)
+{
+    MappedBitArray result = create(path, b.size());
+    std::uint64_t* out = result.data();
+    for (size_t i = 0; i < b.word_count(); ++i)
+        out[i] = b.word(i);
+    result.flush();
+    return result;
+}
+
+
+MappedBitArray MappedBitArray::open(const std::string& path, Mode mode)
+{
+    int fd = ::open(path.c_str(), mode == Mode::read_only ? O_RDONLY : O_RDWR);
+    if (fd < 0)
+        throw_errno("Cannot open " + path);
+
+    auto fail = [fd](const std::string& message) {
+        ::close(fd);
+        throw std::runtime_error(message);
+    };
+
+    // Only the header is read here; the data pages are faulted in on access
+    MappedBitArrayHeader header{};
+    if (::pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))
+        fail("Not a bit array file: " + path);
+    if (std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0)
+        fail("Not a bit array file: " + path);
+    if (header.header_checksum != header_checksum(header))
+        fail("Corrupted bit array header: " + path);
+    if (header.version != format_version)
+        fail("Unsupported bit array format version: " + path);
+    if (header.endianness != endianness_marker || header.word_size != sizeof(std::uint64_t))
+        fail("Bit array file was written with a different word layout: " + path);
+    if (header.header_size != sizeof(MappedBitArrayHeader))
+        fail("Unsupported bit array header size: " + path);
+    // Checked before any sizing, which would wrap for sizes near 2^64
+    if (header.num_bits > BitArray::max_size())
+        fail("Corrupted bit array header: " + path);
+
+    struct stat info {};
+    size_t bytes = file_bytes(header.num_bits);
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < bytes)
+        fail("Truncated bit array file: " + path);
+
+    int protection = mode == Mode::read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* mapping = ::mmap(nullptr, bytes, protection, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        throw_errno("Cannot map " + path);
+    }
+    return MappedBitArray(fd, mode, bytes, mapping);
+}
+
+
+MappedBitArray::MappedBitArray(MappedBitArray&& other) noexcept
+    : fd(other.fd), mode(other.mode), mapped_bytes(other.mapped_bytes), header(other.header),
+      words(other.words), checksum(other.checksum), dirty(other.dirty)
+{
+    other.fd = -1;
+    other.header = nullptr;
+    other.words = nullptr;
+    other.dirty = false;
+}
+
+
+MappedBitArray& MappedBitArray::operator=(MappedBitArray&& other) noexcept
+{
+    if (this != &other) {
+        close();
+        fd = other.fd;
+        mode = other.mode;
+        mapped_bytes = other.mapped_bytes;
+        header = other.header;
+        words = other.words;
+        checksum = other.checksum;
+        dirty = other.dirty;
+        other.fd = -1;
+        other.header = nullptr;
+        other.words = nullptr;
+        other.dirty = false;
+    }
+    return *this;
+}
+
+
+MappedBitArray::~MappedBitArray()
+{
+    close();
+}
+
+
+void MappedBitArray::close() noexcept
+{
+    if (header == nullptr)
+        return;
+    // O(1): a stale checksum stays flagged for the next flush()
+    if (dirty)
+        write_header();
+    ::munmap(header, mapped_bytes);
+    ::close(fd);
+    header = nullptr;
+    words = nullptr;
+    fd = -1;
+}
+
+
+size_t MappedBitArray::word_count() const
+{
+    return (header->num_bits + 63) / 64;
+}
+
+
+std::uint64_t MappedBitArray::compute_checksum() const
+{
+    std::uint64_t hash = empty_checksum(header->num_bits);
+    for (size_t i = 0; i < word_count(); ++i)
+        hash ^= word_hash(i, words[i]);
+    return hash;
+}
+
+
+void MappedBitArray::store_word(size_t i, std::uint64_t word)
+{
+    checksum ^= word_hash(i, words[i]) ^ word_hash(i, word);
+    words[i] = word;
+    dirty = true;
+}
+
+
+void MappedBitArray::write_header()
+{
+    header->data_checksum = checksum;
+    header->header_checksum = header_checksum(*header);
+    dirty = false;
+}
+
+
+void MappedBitArray::check_index(size_t n) const
+{
+    if (n >= header->num_bits) throw std::out_of_range("Index out of bounds");
+}
+
+
+void MappedBitArray::check_writable() const
+{
+    if (mode == Mode::read_only) throw std::logic_error("Bit array file is opened read-only");
+}
+
+
+MappedBitArray& MappedBitArray::set(size_t n, bool val)
+{
+    check_index(n);
+    check_writable();
+    const std::uint64_t mask = 1ULL << (n % 64);
+    const std::uint64_t word = words[n / 64];
+    if (((word & mask) != 0) != val)
+        store_word(n / 64, word ^ mask);
+    return *this;
+}
+
+
+MappedBitArray& MappedBitArray::set()
+{
+    check_writable();
+    std::fill(words, words + word_count(), ~0ULL);
+    if (header->num_bits % 64 != 0)
+        words[word_count() - 1] = last_word_mask(header->num_bits);
+    checksum = compute_checksum();
+    dirty = true;
+    return *this;
+}
+
+
+MappedBitArray& MappedBitArray::reset(size_t n)
+{
+    return set(n, false);
+}
+
+
+MappedBitArray& MappedBitArray::reset()
+{
+    check_writable();
+    std::fill(words, words + word_count(), 0);
+    checksum = empty_checksum(header->num_bits);
+    dirty = true;
+    return *this;
+}
+
+
+bool MappedBitArray::test(size_t n) const
+{
+    check_index(n);
+    return (words[n / 64] >> (n % 64)) & 1;
+}
+
+
+bool MappedBitArray::operator[](size_t n) const
+{
+    return test(n);
+}
+
+
+size_t MappedBitArray::count() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < word_count(); ++i)
+        total += __builtin_popcountll(words[i]);
+    return total;
+}
+
+
+bool MappedBitArray::any() const
+{
+    for (size_t i = 0; i < word_count(); ++i)
+        if (words[i] != 0) return true;
+    return false;
+}
+
+
+size_t MappedBitArray::size() const
+{
+    return header->num_bits;
+}
+
+
+const std::uint64_t* MappedBitArray::data() const
+{
+    return words;
+}
+
+
+std::uint64_t* MappedBitArray::data()
+{
+    check_writable();
+    if (!checksum_is_stale()) {
+        header->flags |= checksum_stale;
+        write_header();
+    }
+    return words;
+}
+
+
+BitArray MappedBitArray::to_bit_array() const
+{
+    BitArray result(header->num_bits);
+    std::copy(words, words + word_count(), result.data());
+    return result;
+}
+
+
+void MappedBitArray::flush()
+{
+    if (mode == Mode::read_only)
+        return;
+    if (checksum_is_stale()) {
+        checksum = compute_checksum();
+        header->flags &= ~checksum_stale;
+        dirty = true;
+    }
+    if (dirty)
+        write_header();
+    if (::msync(header, mapped_bytes, MS_SYNC) != 0)
+        throw_errno("Cannot sync bit array file");
+}
+
+
+bool MappedBitArray::verify() const
+{
+    return !checksum_is_stale() && header->data_checksum == compute_checksum();
+}
+
+
+bool MappedBitArray::checksum_is_stale() const
+{
+    return (header->flags & checksum_stale) != 0;
+}
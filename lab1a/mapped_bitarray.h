@@ -0,0 +1,94 @@
+#ifndef MAPPED_BITARRAY_H
+#define MAPPED_BITARRAY_H
+
+#include "bitarray.h"
+#include <cstdint>
+#include <string>
+
+// On-disk header of a mapped bit array file, followed by the data words
+// (bit i is bit i % 64 of word i / 64, native byte order).
+struct MappedBitArrayHeader {
+    char magic[8];  // "BITARRAY"
+    std::uint32_t version;
+    std::uint32_t word_size;  // Bytes per data word, 8
+    std::uint32_t endianness;  // endianness_marker as written by the creating machine
+    std::uint32_t header_size;  // Offset of the data words
+    std::uint64_t num_bits;
+    std::uint64_t data_checksum;  // XOR of per-word hashes, see MappedBitArray
+    std::uint64_t flags;  // MappedBitArray::checksum_stale
+    std::uint64_t header_checksum;  // Over every byte before this field
+    std::uint8_t reserved[8];
+};
+
+static_assert(sizeof(MappedBitArrayHeader) == 64);
+
+// Bit array whose words live in a memory-mapped file, so it persists between
+// runs and can be far larger than RAM: pages are read in on first access and
+// written back by the kernel. Opening a file only validates the header, so it
+// is O(1); verify() checks the data checksum when that is worth a full pass.
+// The data checksum is an XOR of per-word hashes, so set() and reset() of a
+// single bit update it in O(1) and closing only rewrites the header. Writes
+// through data() cannot be tracked: they mark the checksum stale in the
+// header until flush() recomputes it.
+class MappedBitArray {
+public:
+    enum class Mode { read_only, read_write };
+
+    static constexpr std::uint32_t format_version = 2;
+    static constexpr std::uint32_t endianness_marker = 0x01020304;
+    static constexpr std::uint64_t checksum_stale = 1;  // Header flag: data changed through data()
+
+private:
+    int fd;
+    Mode mode;
+    size_t mapped_bytes;
+    MappedBitArrayHeader* header;
+    std::uint64_t* words;
+    std::uint64_t checksum;  // Running data checksum, written to the header on close() and flush()
+    bool dirty;  // checksum changed since it was last written
+
+    MappedBitArray(int fd, Mode mode, size_t mapped_bytes, void* mapping);
+    void check_index(size_t n) const;
+    void check_writable() const;
+    [[nodiscard]] size_t word_count() const;
+    [[nodiscard]] std::uint64_t compute_checksum() const;
+    void store_word(size_t i, std::uint64_t word);  // Writes word i and updates checksum
+    void write_header();
+    void close() noexcept;
+
+public:
+    // Creates (or truncates) path as a zero-filled array of num_bits bits
+    static MappedBitArray create(const std::string& path, size_t num_bits);
+    static MappedBitArray create(const std::string& path, const BitArray& b);
+    static MappedBitArray open(const std::string& path, Mode mode = Mode::read_write);
+
+    MappedBitArray(const MappedBitArray&) = delete;
+    MappedBitArray& operator=(const MappedBitArray&) = delete;
+    MappedBitArray(MappedBitArray&& other) noexcept;
+    MappedBitArray& operator=(MappedBitArray&& other) noexcept;
+    ~MappedBitArray();  // Writes the running checksum; does not sync or recompute
+
+    MappedBitArray& set(size_t n, bool val = true);
+    MappedBitArray& set();
+    MappedBitArray& reset(size_t n);
+    MappedBitArray& reset();
+    bool test(size_t n) const;
+    bool operator[](size_t n) const;
+
+    [[nodiscard]] size_t count() const;
+    [[nodiscard]] bool any() const;
+    [[nodiscard]] size_t size() const;
+
+    [[nodiscard]] const std::uint64_t* data() const;
+    [[nodiscard]] std::uint64_t* data();  // Marks the checksum stale until flush()
+    [[nodiscard]] BitArray to_bit_array() const;
+
+    // Writes the data checksum, recomputing it if it is stale, and syncs the mapping to disk
+    void flush();
+    // Recomputes the data checksum and compares it with the header; false
+    // while the header checksum is stale
+    [[nodiscard]] bool verify() const;
+    [[nodiscard]] bool checksum_is_stale() const;
+};
+
+#endif // MAPPED_BITARRAY_H
@@ -0,0 +1,212 @@
+#include "packed_int_array.h"
+#include <bit>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PACKED_X86_BMI2 1
+#include <immintrin.h>
+#endif
+
+
+// width (at most 64) bits starting at bit pos, which may straddle two words
+static std::uint64_t extract_bits(const unsigned long* words, size_t pos, unsigned width)
+{
+    const size_t w = pos / 64;
+    const unsigned offset = pos % 64;
+    std::uint64_t value = words[w] >> offset;
+    if (offset + width > 64)
+        value |= static_cast<std::uint64_t>(words[w + 1]) << (64 - offset);
+    return width == 64 ? value : value & ((std::uint64_t(1) << width) - 1);
+}
+
+
+#ifdef PACKED_X86_BMI2
+// Expands groups of lanes values into eight output bytes each: one
+// extract_bits of lanes * width bits, then pdep spreads the values over the
+// lanes selected by lane_mask
+__attribute__((target("bmi2")))
+static void pdep_groups(const unsigned long* words, size_t first_bit, unsigned width, unsigned lanes,
+                        std::uint64_t lane_mask, size_t groups, unsigned char* out)
+{
+    for (size_t g = 0; g < groups; ++g) {
+        std::uint64_t spread = _pdep_u64(extract_bits(words, first_bit + g * lanes * width, lanes * width), lane_mask);
+        std::memcpy(out + 8 * g, &spread, 8);
+    }
+}
+
+
+static bool has_bmi2()
+{
+    static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("bmi2") != 0;
+    }();
+    return supported;
+}
+#endif
+
+
+PackedIntArray::PackedIntArray(unsigned width, size_t size, std::uint64_t value) : bits_per_value(width), num_values(0)
+{
+    if (width < 1 || width > max_width)
+        throw std::invalid_argument("Width must be between 1 and 64");
+    resize(size, value);
+}
+
+
+std::uint64_t PackedIntArray::value_mask() const
+{
+    return bits_per_value == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << bits_per_value) - 1;
+}
+
+
+void PackedIntArray::check_index(size_t i) const
+{
+    if (i >= num_values) throw std::out_of_range("Index out of bounds");
+}
+
+
+void PackedIntArray::check_value(std::uint64_t value) const
+{
+    if ((value & ~value_mask()) != 0) throw std::invalid_argument("Value does not fit in the width");
+}
+
+
+void PackedIntArray::store(size_t i, std::uint64_t value)
+{
+    const size_t pos = i * bits_per_value;
+    const size_t w = pos / 64;
+    const unsigned offset = pos % 64;
+    unsigned long* words = bits.data();
+    words[w] = (words[w] & ~(value_mask() << offset)) | (value << offset);
+    // The high part of a value that straddles a word boundary
+    if (offset + bits_per_value > 64)
+        words[w + 1] = (words[w + 1] & ~(value_mask() >> (64 - offset))) | (value >> (64 - offset));
+}
+
+
+unsigned PackedIntArray::width() const
+{
+    return bits_per_value;
+}
+
+
+size_t PackedIntArray::size() const
+{
+    return num_values;
+}
+
+
+bool PackedIntArray::empty() const
+{
+    return num_values == 0;
+}
+
+
+std::uint64_t PackedIntArray::get(size_t i) const
+{
+    check_index(i);
+    return extract_bits(bits.data(), i * bits_per_value, bits_per_value);
+}
+
+
+std::uint64_t PackedIntArray::operator[](size_t i) const
+{
+    return get(i);
+}
+
+
+PackedIntArray& PackedIntArray::set(size_t i, std::uint64_t value)
+{
+    check_index(i);
+    check_value(value);
+    store(i, value);
+    return *this;
+}
+
+
+void PackedIntArray::push_back(std::uint64_t value)
+{
+    check_value(value);
+    // BitArray::resize grows the buffer geometrically, so appends are amortized O(1)
+    bits.resize(bits.size() + bits_per_value);
+    store(num_values++, value);
+}
+
+
+void PackedIntArray::resize(size_t size, std::uint64_t value)
+{
+    check_value(value);
+    if (size > BitArray::max_size() / bits_per_value)
+        throw std::invalid_argument("Size is too large");
+
+    const size_t old_size = num_values;
+    bits.resize(size * bits_per_value);
+    num_values = size;
+    if (value != 0)
+        for (size_t i = old_size; i < size; ++i)
+            store(i, value);
+}
+
+
+void PackedIntArray::reserve(size_t size)
+{
+    if (size > BitArray::max_size() / bits_per_value)
+        throw std::invalid_argument("Size is too large");
+    bits.reserve(size * bits_per_value);
+}
+
+
+void PackedIntArray::clear()
+{
+    bits.clear();
+    num_values = 0;
+}
+
+
+template <typename T>
+void PackedIntArray::unpack_values(size_t first, std::span<T> out) const
+{
+    if (bits_per_value > 8 * sizeof(T))
+        throw std::invalid_argument("Width does not fit in the output type");
+    if (first > num_values || out.size() > num_values - first)
+        throw std::out_of_range("Range out of bounds");
+
+    const unsigned long* words = bits.data();
+    size_t done = 0;
+#ifdef PACKED_X86_BMI2
+    // Whole groups of eight bytes of output go through pdep
+    if constexpr (std::endian::native == std::endian::little) {
+        if (has_bmi2()) {
+            constexpr unsigned lanes = 8 / sizeof(T);
+            std::uint64_t lane_mask = 0;
+            for (unsigned j = 0; j < lanes; ++j)
+                lane_mask |= value_mask() << (8 * sizeof(T) * j);
+            const size_t groups = out.size() / lanes;
+            pdep_groups(words, first * bits_per_value, bits_per_value, lanes, lane_mask, groups,
+                        reinterpret_cast<unsigned char*>(out.data()));
+            done = groups * lanes;
+        }
+    }
+#endif
+    for (; done < out.size(); ++done)
+        out[done] = static_cast<T>(extract_bits(words, (first + done) * bits_per_value, bits_per_value));
+}
+
+
+void PackedIntArray::unpack(size_t first, std::span<std::uint8_t> out) const
+{
+    unpack_values(first, out);
+}
+
+
+void PackedIntArray::unpack(size_t first, std::span<std::uint16_t> out) const
+{
+    unpack_values(first, out);
+}
+
+
+const BitArray& PackedIntArray::bit_array() const
+{
+    return bits;
+}
@@ -0,0 +1,53 @@
+#ifndef PACKED_INT_ARRAY_H
+#define PACKED_INT_ARRAY_H
+
+#include "bitarray.h"
+#include <cstdint>
+#include <span>
+
+// Array of unsigned integers of a fixed bit width (1 to 64, chosen at run
+// time), packed back to back in BitArray words: value i occupies bits
+// [i * width, (i + 1) * width), so values may straddle two words.
+// get() and set() are a couple of shifts and masks; unpack() expands a run
+// of values into bytes or 16-bit integers several at a time (with BMI2
+// pdep when the CPU has it).
+class PackedIntArray {
+private:
+    unsigned bits_per_value;
+    size_t num_values;
+    BitArray bits;  // num_values * bits_per_value bits
+
+    [[nodiscard]] std::uint64_t value_mask() const;
+    void check_index(size_t i) const;
+    void check_value(std::uint64_t value) const;
+    void store(size_t i, std::uint64_t value);
+
+    template <typename T>
+    void unpack_values(size_t first, std::span<T> out) const;
+
+public:
+    static constexpr unsigned max_width = 64;
+
+    explicit PackedIntArray(unsigned width, size_t size = 0, std::uint64_t value = 0);
+
+    [[nodiscard]] unsigned width() const;
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] bool empty() const;
+
+    std::uint64_t get(size_t i) const;
+    std::uint64_t operator[](size_t i) const;
+    PackedIntArray& set(size_t i, std::uint64_t value);  // value must fit in width() bits
+    void push_back(std::uint64_t value);
+    void resize(size_t size, std::uint64_t value = 0);
+    void reserve(size_t size);
+    void clear();
+
+    // Copies values [first, first + out.size()) into out; width() must not
+    // exceed the bits of the output type
+    void unpack(size_t first, std::span<std::uint8_t> out) const;
+    void unpack(size_t first, std::span<std::uint16_t> out) const;
+
+    [[nodiscard]] const BitArray& bit_array() const;
+};
+
+#endif // PACKED_INT_ARRAY_H
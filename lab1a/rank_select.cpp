@@ -0,0 +1,170 @@
+#include "rank_select.h"
+
+static constexpr size_t words_per_block = 32;  // 2048 bits
+static constexpr size_t words_per_sub_block = 8;  // 512 bits
+static constexpr size_t blocks_per_superblock = size_t(1) << 21;  // 2^32 bits
+static constexpr size_t select_sample_rate = 8192;  // Ones between select samples
+
+
+// Position of the r-th one (from 0) inside a word with more than r ones:
+// halve the window, keeping the half that holds the wanted one
+static size_t select_in_word(unsigned long word, size_t r)
+{
+    size_t pos = 0;
+    for (int width = 32; width >= 1; width /= 2) {
+        size_t low = __builtin_popcountl(word & ((1UL << width) - 1));
+        if (r >= low) {
+            r -= low;
+            word >>= width;
+            pos += width;
+        }
+    }
+    return pos;
+}
+
+
+RankSelect::RankSelect(const BitArray& bits) : bits(&bits), built_generation(0), total_ones(0)
+{
+    rebuild();
+}
+
+
+void RankSelect::rebuild()
+{
+    const size_t num_words = bits->word_count();
+    const size_t num_blocks = (num_words + words_per_block - 1) / words_per_block;
+
+    upper.clear();
+    blocks.assign(num_blocks, 0);
+    select_samples.clear();
+
+    size_t cumulative = 0;
+    size_t next_sample = 0;
+    for (size_t b = 0; b < num_blocks; ++b) {
+        if (b % blocks_per_superblock == 0)
+            upper.push_back(cumulative);
+
+        std::uint64_t entry = cumulative - upper.back();
+        size_t block_ones = 0;
+        for (size_t s = 0; s < words_per_block / words_per_sub_block; ++s) {
+            size_t sub_ones = 0;
+            size_t first = b * words_per_block + s * words_per_sub_block;
+            for (size_t w = first; w < std::min(first + words_per_sub_block, num_words); ++w)
+                sub_ones += __builtin_popcountl(bits->word(w));
+            if (s < 3)
+                entry |= std::uint64_t(sub_ones) << (32 + 10 * s);
+            block_ones += sub_ones;
+        }
+        blocks[b] = entry;
+
+        cumulative += block_ones;
+        for (; next_sample < cumulative; next_sample += select_sample_rate)
+            select_samples.push_back(b);
+    }
+
+    total_ones = cumulative;
+    built_generation = bits->generation();
+}
+
+
+bool RankSelect::is_valid() const
+{
+    return built_generation == bits->generation();
+}
+
+
+void RankSelect::check_valid() const
+{
+    if (!is_valid())
+        throw std::logic_error("Rank/select index is out of date, call rebuild()");
+}
+
+
+size_t RankSelect::block_rank(size_t block) const
+{
+    return upper[block / blocks_per_superblock] + (blocks[block] & 0xffffffffULL);
+}
+
+
+size_t RankSelect::rank1(size_t i) const
+{
+    check_valid();
+    if (i > size()) throw std::out_of_range("Index out of bounds");
+    if (i == size())
+        return total_ones;
+
+    const size_t block = i / (64 * words_per_block);
+    const size_t sub_block = (i / (64 * words_per_sub_block)) % (words_per_block / words_per_sub_block);
+    size_t result = block_rank(block);
+    for (size_t s = 0; s < sub_block; ++s)
+        result += (blocks[block] >> (32 + 10 * s)) & 0x3ff;
+
+    size_t w = block * words_per_block + sub_block * words_per_sub_block;
+    for (; w < i / 64; ++w)
+        result += __builtin_popcountl(bits->word(w));
+    if (i % 64 != 0)
+        result += __builtin_popcountl(bits->word(w) & ((1UL << (i % 64)) - 1));
+    return result;
+}
+
+
+size_t RankSelect::rank0(size_t i) const
+{
+    return i - rank1(i);
+}
+
+
+size_t RankSelect::select1(size_t k) const
+{
+    check_valid();
+    if (k >= total_ones) throw std::out_of_range("Rank out of bounds");
+
+    // The samples bound the blocks that can hold the k-th one
+    const size_t sample = k / select_sample_rate;
+    size_t lo = select_samples[sample];
+    size_t hi = sample + 1 < select_samples.size() ? select_samples[sample + 1] + 1 : blocks.size();
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (block_rank(mid) <= k)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    size_t remaining = k - block_rank(lo);
+    size_t sub_block = 0;
+    for (; sub_block < 3; ++sub_block) {
+        size_t sub_ones = (blocks[lo] >> (32 + 10 * sub_block)) & 0x3ff;
+        if (remaining < sub_ones)
+            break;
+        remaining -= sub_ones;
+    }
+
+    for (size_t w = lo * words_per_block + sub_block * words_per_sub_block;; ++w) {
+        unsigned long word = bits->word(w);
+        size_t word_ones = __builtin_popcountl(word);
+        if (remaining < word_ones)
+            return w * 64 + select_in_word(word, remaining);
+        remaining -= word_ones;
+    }
+}
+
+
+size_t RankSelect::ones() const
+{
+    check_valid();
+    return total_ones;
+}
+
+
+size_t RankSelect::size() const
+{
+    return bits->size();
+}
+
+
+size_t RankSelect::memory_usage() const
+{
+    return upper.size() * sizeof(std::uint64_t) + blocks.size() * sizeof(std::uint64_t) +
+           select_samples.size() * sizeof(std::uint64_t);
+}
@@ -0,0 +1,50 @@
+#ifndef RANK_SELECT_H
+#define RANK_SELECT_H
+
+#include "bitarray.h"
+#include <cstdint>
+#include <vector>
+
+// Rank/select index over a BitArray in the cs-poppy layout:
+//  - upper:  ones before each 2^32-bit superblock (64 bits each)
+//  - blocks: one 64-bit entry per 2048-bit block holding the ones before the
+//            block relative to its superblock (32 bits) and the counts of its
+//            first three 512-bit sub-blocks (10 bits each)
+//  - select_samples: the block holding every 8192-th one
+// That is about 3.2% on top of the bits. rank1() is O(1) (at most seven
+// word popcounts), select1() binary-searches between two samples.
+//
+// The index keeps a pointer to the array, which must outlive it. Mutating
+// the array makes the index stale: queries then throw std::logic_error
+// until rebuild() is called.
+class RankSelect {
+private:
+    const BitArray* bits;
+    unsigned long built_generation;
+    size_t total_ones;
+    std::vector<std::uint64_t> upper;
+    std::vector<std::uint64_t> blocks;
+    std::vector<std::uint64_t> select_samples;  // Block indices pass 2^32 at 2^43 bits
+
+    [[nodiscard]] size_t block_rank(size_t block) const;  // Ones before the start of block
+    void check_valid() const;
+
+public:
+    explicit RankSelect(const BitArray& bits);
+
+    void rebuild();
+    [[nodiscard]] bool is_valid() const;
+
+    // Number of ones (zeros) in [0, i), i <= size()
+    size_t rank1(size_t i) const;
+    size_t rank0(size_t i) const;
+
+    // Position of the k-th one, counting from 0; k < ones()
+    size_t select1(size_t k) const;
+
+    [[nodiscard]] size_t ones() const;
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] size_t memory_usage() const;  // Bytes used by the index itself
+};
+
+#endif // RANK_SELECT_H
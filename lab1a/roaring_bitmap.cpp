@@ -0,0 +1,606 @@
+#include "roaring_bitmap.h"
+
+using ArrayContainer = RoaringBitmap::ArrayContainer;
+using BitmapContainer = RoaringBitmap::BitmapContainer;
+using RunContainer = RoaringBitmap::RunContainer;
+using Run = RoaringBitmap::Run;
+using Container = RoaringBitmap::Container;
+
+static constexpr size_t chunk_bits = 65536;
+static constexpr size_t chunk_words = chunk_bits / 64;
+static constexpr size_t array_max = 4096;  // Past this an array is bigger than a bitmap
+
+
+// Container helpers
+
+static void set_word_range(std::uint64_t* words, size_t first, size_t last)  // Bits [first, last]
+{
+    size_t first_word = first / 64, last_word = last / 64;
+    std::uint64_t first_mask = ~0ULL << (first % 64);
+    std::uint64_t last_mask = ~0ULL >> (63 - last % 64);
+    if (first_word == last_word) {
+        words[first_word] |= first_mask & last_mask;
+        return;
+    }
+    words[first_word] |= first_mask;
+    std::fill(words + first_word + 1, words + last_word, ~0ULL);
+    words[last_word] |= last_mask;
+}
+
+
+static size_t popcount_words(const std::uint64_t* words, size_t n)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i)
+        total += __builtin_popcountll(words[i]);
+    return total;
+}
+
+
+static size_t cardinality(const Container& c)
+{
+    if (auto* array = std::get_if<ArrayContainer>(&c))
+        return array->values.size();
+    if (auto* bitmap = std::get_if<BitmapContainer>(&c))
+        return bitmap->cardinality;
+    size_t total = 0;
+    for (const Run& run : std::get<RunContainer>(c).runs)
+        total += run.length + 1;
+    return total;
+}
+
+
+static bool contains(const Container& c, std::uint16_t low)
+{
+    if (auto* array = std::get_if<ArrayContainer>(&c))
+        return std::binary_search(array->values.begin(), array->values.end(), low);
+    if (auto* bitmap = std::get_if<BitmapContainer>(&c))
+        return (bitmap->words[low / 64] >> (low % 64)) & 1;
+
+    const auto& runs = std::get<RunContainer>(c).runs;
+    auto it = std::upper_bound(runs.begin(), runs.end(), low,
+                               [](std::uint16_t value, const Run& run) { return value < run.start; });
+    return it != runs.begin() && low <= (it - 1)->start + (it - 1)->length;
+}
+
+
+// ORs the contents of c into bitmap (cardinality is not updated)
+static void or_into(BitmapContainer& bitmap, const Container& c)
+{
+    if (auto* array = std::get_if<ArrayContainer>(&c)) {
+        for (std::uint16_t v : array->values)
+            bitmap.words[v / 64] |= 1ULL << (v % 64);
+    } else if (auto* other = std::get_if<BitmapContainer>(&c)) {
+        for (size_t i = 0; i < chunk_words; ++i)
+            bitmap.words[i] |= other->words[i];
+    } else {
+        for (const Run& run : std::get<RunContainer>(c).runs)
+            set_word_range(bitmap.words.data(), run.start, run.start + run.length);
+    }
+}
+
+
+static BitmapContainer to_bitmap(const Container& c)
+{
+    BitmapContainer bitmap{std::vector<std::uint64_t>(chunk_words, 0), 0};
+    or_into(bitmap, c);
+    bitmap.cardinality = cardinality(c);
+    return bitmap;
+}
+
+
+// Picks array or bitmap for a bitmap whose cardinality is up to date
+static Container shrink(BitmapContainer&& bitmap)
+{
+    if (bitmap.cardinality > array_max)
+        return std::move(bitmap);
+
+    ArrayContainer array;
+    array.values.reserve(bitmap.cardinality);
+    for (size_t i = 0; i < chunk_words; ++i)
+        for (std::uint64_t w = bitmap.words[i]; w != 0; w &= w - 1)
+            array.values.push_back(static_cast<std::uint16_t>(i * 64 + __builtin_ctzll(w)));
+    return array;
+}
+
+
+static Container array_or_bitmap(ArrayContainer&& array)
+{
+    if (array.values.size() <= array_max)
+        return std::move(array);
+    return to_bitmap(Container(std::move(array)));
+}
+
+
+static void append_to_runs(std::vector<Run>& runs, std::uint16_t value)
+{
+    if (!runs.empty() && runs.back().start + runs.back().length + 1 == value)
+        ++runs.back().length;
+    else
+        runs.push_back(Run{value, 0});
+}
+
+
+static RunContainer to_runs(const Container& c)
+{
+    if (auto* runs = std::get_if<RunContainer>(&c))
+        return *runs;
+
+    RunContainer result;
+    if (auto* array = std::get_if<ArrayContainer>(&c)) {
+        for (std::uint16_t v : array->values)
+            append_to_runs(result.runs, v);
+    } else {
+        const auto& words = std::get<BitmapContainer>(c).words;
+        for (size_t i = 0; i < chunk_words; ++i)
+            for (std::uint64_t w = words[i]; w != 0; w &= w - 1)
+                append_to_runs(result.runs, static_cast<std::uint16_t>(i * 64 + __builtin_ctzll(w)));
+    }
+    return result;
+}
+
+
+static size_t container_bytes(const Container& c)
+{
+    if (auto* array = std::get_if<ArrayContainer>(&c))
+        return array->values.size() * sizeof(std::uint16_t);
+    if (std::holds_alternative<BitmapContainer>(c))
+        return chunk_words * sizeof(std::uint64_t);
+    return std::get<RunContainer>(c).runs.size() * sizeof(Run);
+}
+
+
+static void add(Container& c, std::uint16_t low)
+{
+    if (auto* array = std::get_if<ArrayContainer>(&c)) {
+        auto it = std::lower_bound(array->values.begin(), array->values.end(), low);
+        if (it != array->values.end() && *it == low)
+            return;
+        array->values.insert(it, low);
+        if (array->values.size() > array_max)
+            c = to_bitmap(c);
+    } else if (auto* bitmap = std::get_if<BitmapContainer>(&c)) {
+        std::uint64_t mask = 1ULL << (low % 64);
+        if (!(bitmap->words[low / 64] & mask)) {
+            bitmap->words[low / 64] |= mask;
+            ++bitmap->cardinality;
+        }
+    } else {
+        auto& runs = std::get<RunContainer>(c).runs;
+        auto next = std::upper_bound(runs.begin(), runs.end(), low,
+                                     [](std::uint16_t value, const Run& run) { return value < run.start; });
+        if (next != runs.begin()) {
+            auto prev = next - 1;
+            int end = prev->start + prev->length;
+            if (low <= end)
+                return;
+            if (low == end + 1) {
+                ++prev->length;
+                // The gap to the next run may have just closed
+                if (next != runs.end() && next->start == low + 1) {
+                    prev->length += next->length + 1;
+                    runs.erase(next);
+                }
+                return;
+            }
+        }
+        if (next != runs.end() && next->start == low + 1) {
+            next->start = low;
+            ++next->length;
+            return;
+        }
+        runs.insert(next, Run{low, 0});
+    }
+}
+
+
+static void remove(Container& c, std::uint16_t low)
+{
+    if (auto* array = std::get_if<ArrayContainer>(&c)) {
+        auto it = std::lower_bound(array->values.begin(), array->values.end(), low);
+        if (it != array->values.end() && *it == low)
+            array->values.erase(it);
+    } else if (auto* bitmap = std::get_if<BitmapContainer>(&c)) {
+        std::uint64_t mask = 1ULL << (low % 64);
+        if (bitmap->words[low / 64] & mask) {
+            bitmap->words[low / 64] &= ~mask;
+            if (--bitmap->cardinality <= array_max)
+                c = shrink(std::move(*bitmap));
+        }
+    } else {
+        auto& runs = std::get<RunContainer>(c).runs;
+        auto next = std::upper_bound(runs.begin(), runs.end(), low,
+                                     [](std::uint16_t value, const Run& run) { return value < run.start; });
+        if (next == runs.begin())
+            return;
+        auto prev = next - 1;
+        int start = prev->start, end = prev->start + prev->length;
+        if (low > end)
+            return;
+
+        if (start == end) {
+            runs.erase(prev);
+        } else if (low == start) {
+            ++prev->start;
+            --prev->length;
+        } else if (low == end) {
+            --prev->length;
+        } else {
+            prev->length = static_cast<std::uint16_t>(low - 1 - start);
+            runs.insert(next, Run{static_cast<std::uint16_t>(low + 1), static_cast<std::uint16_t>(end - low - 1)});
+        }
+    }
+}
+
+
+static Container and_containers(const Container& a, const Container& b)
+{
+    // An array side only needs membership tests on the other side
+    if (auto* array = std::get_if<ArrayContainer>(&a)) {
+        ArrayContainer result;
+        for (std::uint16_t v : array->values)
+            if (contains(b, v))
+                result.values.push_back(v);
+        return result;
+    }
+    if (std::holds_alternative<ArrayContainer>(b))
+        return and_containers(b, a);
+
+    if (std::holds_alternative<RunContainer>(a) && std::holds_alternative<RunContainer>(b)) {
+        const auto& ra = std::get<RunContainer>(a).runs;
+        const auto& rb = std::get<RunContainer>(b).runs;
+        RunContainer result;
+        for (size_t i = 0, j = 0; i < ra.size() && j < rb.size();) {
+            int a_end = ra[i].start + ra[i].length, b_end = rb[j].start + rb[j].length;
+            int start = std::max<int>(ra[i].start, rb[j].start), end = std::min(a_end, b_end);
+            if (start <= end)
+                result.runs.push_back(Run{static_cast<std::uint16_t>(start), static_cast<std::uint16_t>(end - start)});
+            if (a_end < b_end)
+                ++i;
+            else
+                ++j;
+        }
+        return result;
+    }
+
+    BitmapContainer result = to_bitmap(a);
+    BitmapContainer other = to_bitmap(b);
+    for (size_t i = 0; i < chunk_words; ++i)
+        result.words[i] &= other.words[i];
+    result.cardinality = popcount_words(result.words.data(), chunk_words);
+    return shrink(std::move(result));
+}
+
+
+static Container or_containers(const Container& a, const Container& b)
+{
+    if (std::holds_alternative<ArrayContainer>(a) && std::holds_alternative<ArrayContainer>(b)) {
+        const auto& va = std::get<ArrayContainer>(a).values;
+        const auto& vb = std::get<ArrayContainer>(b).values;
+        ArrayContainer result;
+        result.values.reserve(va.size() + vb.size());
+        std::set_union(va.begin(), va.end(), vb.begin(), vb.end(), std::back_inserter(result.values));
+        return array_or_bitmap(std::move(result));
+    }
+
+    if (std::holds_alternative<RunContainer>(a) && std::holds_alternative<RunContainer>(b)) {
+        const auto& ra = std::get<RunContainer>(a).runs;
+        const auto& rb = std::get<RunContainer>(b).runs;
+        std::vector<Run> merged;
+        std::merge(ra.begin(), ra.end(), rb.begin(), rb.end(), std::back_inserter(merged),
+                   [](const Run& x, const Run& y) { return x.start < y.start; });
+        RunContainer result;
+        for (const Run& run : merged) {
+            if (!result.runs.empty()) {
+                Run& last = result.runs.back();
+                int last_end = last.start + last.length;
+                if (run.start <= last_end + 1) {
+                    last.length = static_cast<std::uint16_t>(std::max(last_end, run.start + run.length) - last.start);
+                    continue;
+                }
+            }
+            result.runs.push_back(run);
+        }
+        return result;
+    }
+
+    BitmapContainer result = to_bitmap(a);
+    or_into(result, b);
+    result.cardinality = popcount_words(result.words.data(), chunk_words);
+    return shrink(std::move(result));
+}
+
+
+static Container xor_containers(const Container& a, const Container& b)
+{
+    if (std::holds_alternative<ArrayContainer>(a) && std::holds_alternative<ArrayContainer>(b)) {
+        const auto& va = std::get<ArrayContainer>(a).values;
+        const auto& vb = std::get<ArrayContainer>(b).values;
+        ArrayContainer result;
+        std::set_symmetric_difference(va.begin(), va.end(), vb.begin(), vb.end(), std::back_inserter(result.values));
+        return array_or_bitmap(std::move(result));
+    }
+
+    BitmapContainer result = to_bitmap(a);
+    BitmapContainer other = to_bitmap(b);
+    for (size_t i = 0; i < chunk_words; ++i)
+        result.words[i] ^= other.words[i];
+    result.cardinality = popcount_words(result.words.data(), chunk_words);
+    return shrink(std::move(result));
+}
+
+
+static bool equal_containers(const Container& a, const Container& b)
+{
+    if (cardinality(a) != cardinality(b))
+        return false;
+    if (std::holds_alternative<ArrayContainer>(a) && std::holds_alternative<ArrayContainer>(b))
+        return std::get<ArrayContainer>(a).values == std::get<ArrayContainer>(b).values;
+    return to_bitmap(a).words == to_bitmap(b).words;
+}
+
+
+// RoaringBitmap
+
+RoaringBitmap::RoaringBitmap() : num_bits(0) {}
+
+
+RoaringBitmap::RoaringBitmap(size_t num_bits) : num_bits(num_bits)
+{
+    if (num_bits > max_bits)
+        throw std::invalid_argument("Size must be <= 2^32");
+}
+
+
+RoaringBitmap::RoaringBitmap(const BitArray& b) : RoaringBitmap(b.size())
+{
+    const unsigned long* words = b.data();
+    const size_t num_words = b.word_count();
+    for (size_t first = 0; first < num_words; first += chunk_words) {
+        BitmapContainer bitmap{std::vector<std::uint64_t>(chunk_words, 0), 0};
+        size_t n = std::min(chunk_words, num_words - first);
+        std::copy(words + first, words + first + n, bitmap.words.begin());
+
+        bitmap.cardinality = popcount_words(bitmap.words.data(), n);
+        if (bitmap.cardinality == 0)
+            continue;
+        keys.push_back(static_cast<std::uint16_t>(first / chunk_words));
+        containers.push_back(shrink(std::move(bitmap)));
+    }
+}
+
+
+BitArray RoaringBitmap::to_bit_array() const
+{
+    BitArray result(num_bits);
+    unsigned long* words = result.data();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        size_t first = size_t(keys[i]) * chunk_words;
+        size_t n = std::min(chunk_words, result.word_count() - first);
+        if (auto* bitmap = std::get_if<BitmapContainer>(&containers[i])) {
+            std::copy(bitmap->words.begin(), bitmap->words.begin() + n, words + first);
+        } else {
+            BitmapContainer expanded = to_bitmap(containers[i]);
+            std::copy(expanded.words.begin(), expanded.words.begin() + n, words + first);
+        }
+    }
+    return result;
+}
+
+
+size_t RoaringBitmap::find_key(std::uint16_t key) const
+{
+    auto it = std::lower_bound(keys.begin(), keys.end(), key);
+    return it != keys.end() && *it == key ? it - keys.begin() : keys.size();
+}
+
+
+void RoaringBitmap::check_index(size_t n) const
+{
+    if (n >= num_bits) throw std::out_of_range("Index out of bounds");
+}
+
+
+RoaringBitmap& RoaringBitmap::set(size_t n, bool val)
+{
+    check_index(n);
+    auto key = static_cast<std::uint16_t>(n >> 16);
+    auto low = static_cast<std::uint16_t>(n & 0xffff);
+    auto it = std::lower_bound(keys.begin(), keys.end(), key);
+    size_t i = it - keys.begin();
+
+    if (it == keys.end() || *it != key) {
+        if (!val)
+            return *this;
+        keys.insert(it, key);
+        containers.insert(containers.begin() + i, ArrayContainer{{low}});
+        return *this;
+    }
+
+    if (val) {
+        add(containers[i], low);
+    } else {
+        remove(containers[i], low);
+        if (cardinality(containers[i]) == 0) {
+            keys.erase(it);
+            containers.erase(containers.begin() + i);
+        }
+    }
+    return *this;
+}
+
+
+RoaringBitmap& RoaringBitmap::reset(size_t n)
+{
+    return set(n, false);
+}
+
+
+RoaringBitmap& RoaringBitmap::reset()
+{
+    keys.clear();
+    containers.clear();
+    return *this;
+}
+
+
+bool RoaringBitmap::test(size_t n) const
+{
+    check_index(n);
+    size_t i = find_key(static_cast<std::uint16_t>(n >> 16));
+    return i != keys.size() && contains(containers[i], static_cast<std::uint16_t>(n & 0xffff));
+}
+
+
+bool RoaringBitmap::operator[](size_t n) const
+{
+    return test(n);
+}
+
+
+size_t RoaringBitmap::count() const
+{
+    size_t total = 0;
+    for (const Container& c : containers)
+        total += cardinality(c);
+    return total;
+}
+
+
+bool RoaringBitmap::any() const
+{
+    return !containers.empty();  // Empty containers are never kept
+}
+
+
+bool RoaringBitmap::none() const
+{
+    return !any();
+}
+
+
+size_t RoaringBitmap::size() const
+{
+    return num_bits;
+}
+
+
+bool RoaringBitmap::empty() const
+{
+    return num_bits == 0;
+}
+
+
+void RoaringBitmap::run_optimize()
+{
+    for (Container& c : containers) {
+        RunContainer runs = to_runs(c);
+        size_t run_bytes = runs.runs.size() * sizeof(Run);
+        size_t card = cardinality(c);
+        size_t best_other = card <= array_max ? card * sizeof(std::uint16_t) : chunk_words * sizeof(std::uint64_t);
+
+        if (run_bytes < best_other)
+            c = std::move(runs);
+        else if (std::holds_alternative<RunContainer>(c))
+            c = card <= array_max ? shrink(to_bitmap(c)) : Container(to_bitmap(c));
+    }
+}
+
+
+size_t RoaringBitmap::memory_usage() const
+{
+    size_t total = keys.size() * (sizeof(std::uint16_t) + sizeof(Container));
+    for (const Container& c : containers)
+        total += container_bytes(c);
+    return total;
+}
+
+
+// Walks both key lists in order; op combines chunks present on both sides,
+// keep_only_a / keep_only_b copy the chunks present on one side only
+template <typename ContainerOp>
+RoaringBitmap RoaringBitmap::combine(const RoaringBitmap& a, const RoaringBitmap& b, ContainerOp op,
+                                     bool keep_only_a, bool keep_only_b)
+{
+    if (a.num_bits != b.num_bits) throw std::invalid_argument("Sizes must be equal");
+
+    RoaringBitmap result(a.num_bits);
+    size_t i = 0, j = 0;
+    while (i < a.keys.size() || j < b.keys.size()) {
+        if (j == b.keys.size() || (i < a.keys.size() && a.keys[i] < b.keys[j])) {
+            if (keep_only_a) {
+                result.keys.push_back(a.keys[i]);
+                result.containers.push_back(a.containers[i]);
+            }
+            ++i;
+        } else if (i == a.keys.size() || b.keys[j] < a.keys[i]) {
+            if (keep_only_b) {
+                result.keys.push_back(b.keys[j]);
+                result.containers.push_back(b.containers[j]);
+            }
+            ++j;
+        } else {
+            Container c = op(a.containers[i], b.containers[j]);
+            if (cardinality(c) != 0) {
+                result.keys.push_back(a.keys[i]);
+                result.containers.push_back(std::move(c));
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+
+RoaringBitmap& RoaringBitmap::operator&=(const RoaringBitmap& b)
+{
+    return *this = *this & b;
+}
+
+
+RoaringBitmap& RoaringBitmap::operator|=(const RoaringBitmap& b)
+{
+    return *this = *this | b;
+}
+
+
+RoaringBitmap& RoaringBitmap::operator^=(const RoaringBitmap& b)
+{
+    return *this = *this ^ b;
+}
+
+
+bool operator==(const RoaringBitmap& a, const RoaringBitmap& b)
+{
+    if (a.num_bits != b.num_bits || a.keys != b.keys)
+        return false;
+    for (size_t i = 0; i < a.containers.size(); ++i)
+        if (!equal_containers(a.containers[i], b.containers[i]))
+            return false;
+    return true;
+}
+
+
+bool operator!=(const RoaringBitmap& a, const RoaringBitmap& b)
+{
+    return !(a == b);
+}
+
+
+RoaringBitmap operator&(const RoaringBitmap& a, const RoaringBitmap& b)
+{
+    return RoaringBitmap::combine(a, b, and_containers, false, false);
+}
+
+
+RoaringBitmap operator|(const RoaringBitmap& a, const RoaringBitmap& b)
+{
+    return RoaringBitmap::combine(a, b, or_containers, true, true);
+}
+
+
+RoaringBitmap operator^(const RoaringBitmap& a, const RoaringBitmap& b)
+{
+    return RoaringBitmap::combine(a, b, xor_containers, true, true);
+}
@@ -0,0 +1,94 @@
+#ifndef ROARING_BITMAP_H
+#define ROARING_BITMAP_H
+
+#include "bitarray.h"
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+// Compressed bitmap for wide, sparse (or run-heavy) bit sets, up to 2^32 bits.
+// Positions are split into 2^16-bit chunks keyed by their high 16 bits; only
+// non-empty chunks are stored, each in the cheapest of three containers:
+//  - array:  sorted low 16 bits of the set positions (at most 4096 of them)
+//  - bitmap: 1024 plain words
+//  - run:    sorted [start, start + length] intervals (see run_optimize())
+// The interface follows BitArray: a fixed size, set/reset/test/count and the
+// bitwise operators, which work container by container.
+class RoaringBitmap {
+public:
+    struct ArrayContainer {
+        std::vector<std::uint16_t> values;
+    };
+
+    struct BitmapContainer {
+        std::vector<std::uint64_t> words;  // Always 1024 words
+        size_t cardinality = 0;
+    };
+
+    struct Run {
+        std::uint16_t start;
+        std::uint16_t length;  // Number of bits after start, so a run covers length + 1 bits
+    };
+
+    struct RunContainer {
+        std::vector<Run> runs;
+    };
+
+    using Container = std::variant<ArrayContainer, BitmapContainer, RunContainer>;
+
+private:
+    size_t num_bits;  // Width of the bitmap, at most 2^32
+    std::vector<std::uint16_t> keys;  // Sorted high 16 bits of the stored chunks
+    std::vector<Container> containers;  // containers[i] holds chunk keys[i]
+
+    [[nodiscard]] size_t find_key(std::uint16_t key) const;  // Index of key in keys or keys.size()
+    void check_index(size_t n) const;
+
+    template <typename ContainerOp>
+    static RoaringBitmap combine(const RoaringBitmap& a, const RoaringBitmap& b, ContainerOp op,
+                                 bool keep_only_a, bool keep_only_b);
+
+public:
+    static constexpr size_t max_bits = size_t(1) << 32;
+
+    RoaringBitmap();
+    explicit RoaringBitmap(size_t num_bits);
+    explicit RoaringBitmap(const BitArray& b);
+
+    [[nodiscard]] BitArray to_bit_array() const;
+
+    friend bool operator==(const RoaringBitmap& a, const RoaringBitmap& b);
+    friend bool operator!=(const RoaringBitmap& a, const RoaringBitmap& b);
+    friend RoaringBitmap operator&(const RoaringBitmap& a, const RoaringBitmap& b);
+    friend RoaringBitmap operator|(const RoaringBitmap& a, const RoaringBitmap& b);
+    friend RoaringBitmap operator^(const RoaringBitmap& a, const RoaringBitmap& b);
+
+    RoaringBitmap& operator&=(const RoaringBitmap& b);
+    RoaringBitmap& operator|=(const RoaringBitmap& b);
+    RoaringBitmap& operator^=(const RoaringBitmap& b);
+
+    RoaringBitmap& set(size_t n, bool val = true);
+    RoaringBitmap& reset(size_t n);
+    RoaringBitmap& reset();
+    [[nodiscard]] bool test(size_t n) const;
+    bool operator[](size_t n) const;
+
+    [[nodiscard]] size_t count() const;
+    [[nodiscard]] bool any() const;
+    [[nodiscard]] bool none() const;
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] bool empty() const;
+
+    // Re-encode every container in its smallest form, including runs
+    void run_optimize();
+
+    [[nodiscard]] size_t memory_usage() const;  // Approximate bytes held by the containers
+};
+
+bool operator==(const RoaringBitmap& a, const RoaringBitmap& b);
+bool operator!=(const RoaringBitmap& a, const RoaringBitmap& b);
+RoaringBitmap operator&(const RoaringBitmap& a, const RoaringBitmap& b);
+RoaringBitmap operator|(const RoaringBitmap& a, const RoaringBitmap& b);
+RoaringBitmap operator^(const RoaringBitmap& a, const RoaringBitmap& b);
+
+#endif // ROARING_BITMAP_H
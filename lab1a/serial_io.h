@@ -0,0 +1,55 @@
+#ifndef SERIAL_IO_H
+#define SERIAL_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Helpers behind the serialize()/deserialize() images. Every image starts
+// with the same 24-byte header: an 8-byte magic, a 4-byte little-endian
+// version and 12 bytes the format fills in itself; all integers are
+// little-endian whatever the host order.
+
+inline constexpr size_t serial_header_size = 24;
+
+
+inline void put_le(std::vector<std::uint8_t>& out, std::uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i)
+        out.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+}
+
+
+inline std::uint64_t get_le(const std::uint8_t* in, size_t bytes)
+{
+    std::uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        value |= std::uint64_t(in[i]) << (8 * i);
+    return value;
+}
+
+
+// Magic and version; the format appends the remaining 12 header bytes
+inline std::vector<std::uint8_t> start_serial_header(const char (&magic)[8], std::uint32_t version)
+{
+    std::vector<std::uint8_t> out(magic, magic + sizeof(magic));
+    put_le(out, version, 4);
+    return out;
+}
+
+
+// Throws invalid_argument naming what unless bytes start with a header of this magic and version
+inline void check_serial_header(std::span<const std::uint8_t> bytes, const char (&magic)[8], std::uint32_t version,
+                                const char* what)
+{
+    if (bytes.size() < serial_header_size || std::memcmp(bytes.data(), magic, sizeof(magic)) != 0)
+        throw std::invalid_argument(std::string("Not a serialized ") + what);
+    if (get_le(bytes.data() + 8, 4) != version)
+        throw std::invalid_argument(std::string("Unsupported ") + what + " version");
+}
+
+#endif // SERIAL_IO_H